@@ -44,18 +44,29 @@
 #include <map>
 #include <vector>
 #include <set>
+#include <deque>
 #include <boost/shared_ptr.hpp>
+#include <boost/atomic.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <bondcpp/bond.h>
+#include "diagnostic_aggregator/bond_tracker.h"
+#include "diagnostic_aggregator/publisher_limiter.h"
 #include <diagnostic_msgs/DiagnosticArray.h>
 #include <diagnostic_msgs/DiagnosticStatus.h>
 #include <diagnostic_msgs/KeyValue.h>
 #include <diagnostic_msgs/AddDiagnostics.h>
+#include <diagnostic_aggregator/GetStatusHistory.h>
+#include <diagnostic_aggregator/ReloadAnalyzers.h>
+#include <diagnostic_aggregator/StatusEventArray.h>
 #include "XmlRpcValue.h"
 #include "diagnostic_aggregator/analyzer.h"
 #include "diagnostic_aggregator/analyzer_group.h"
 #include "diagnostic_aggregator/status_item.h"
 #include "diagnostic_aggregator/other_analyzer.h"
+#include "diagnostic_aggregator/serialized_status_cache.h"
+#include "diagnostic_aggregator/snapshot.h"
 
 
 namespace diagnostic_aggregator {
@@ -87,6 +98,8 @@ Output:
 base_path: My Robot
 pub_rate: 1.0
 other_as_errors: false
+profile_analyzers: false
+match_cache_bytes: 0
 analyzers:
   sensors:
     type: GenericAnalyzer
@@ -101,6 +114,112 @@ analyzers:
  * Any other parameters in the namespace can by used to specify the analyzer. If
  * any analyzer is not properly specified, or returns false on initialization,
  * the aggregator will report the error and publish it in the aggregated output.
+ *
+ * The aggregator publishes statistics about itself on /diagnostics_agg/stats,
+ * like the match cache counters of its AnalyzerGroup. If "profile_analyzers"
+ * is true, the time spent in each top-level analyzer is published there too,
+ * one status per analyzer path.
+ *
+ * If "num_shards" is greater than 1, the aggregator loads one copy of the
+ * analyzers per shard, and analyzes each shard in its own thread. Incoming
+ * status names are hashed to a shard, and the shard outputs are merged when
+ * publishing. A header reported by several shards is recomputed from its
+ * merged children, and the "num_items" check of a GenericAnalyzer is done
+ * again on the merged items. Other header levels that don't come from the
+ * children, like the rate check of a GenericAnalyzer, are lost in the merge.
+ *
+ * If "publish_deltas" is true, the statuses that changed since the last
+ * publish are also published on /diagnostics_agg/delta, along with all
+ * statuses every "delta_full_period" seconds. An UpstreamAnalyzer in
+ * another aggregator can consume this topic instead of /diagnostics_agg.
+ *
+ * If "snapshot_file" is set, the latest status of every item and its match
+ * results are written to that file every "snapshot_period" seconds, by a
+ * thread of its own so publishing doesn't wait for the disk. On start,
+ * the aggregator loads the file and analyzes its items with their original
+ * update times, so it doesn't report everything as missing after a restart.
+ *
+ * Analyzers added by the AddDiagnostics service are added to a copy of the
+ * analyzer tree of each shard, which then replaces the current tree. Analyzing
+ * and publishing keep using the tree they started with until they are done, so
+ * bonds forming or breaking don't wait for them, or make them wait.
+ *
+ * The ReloadAnalyzers service /diagnostics_agg/reload reads the "analyzers"
+ * parameters again. Top-level analyzers whose parameters didn't change are
+ * kept, with their items and match results, the others are loaded again and
+ * given the current items. Changing one analyzer in an AnalyzerGroup reloads
+ * the whole group. If any analyzer fails to load, the service fails and all
+ * current analyzers are kept.
+ *
+ * Each client of the AddDiagnostics service has its own bond topic,
+ * /diagnostics_agg/bond + NAMESPACE, with its own subscriber and timers in the
+ * aggregator. If "multiplex_bonds" is true, a BondTracker keeps all bonds
+ * with one subscriber and one timer instead. Clients send their heartbeats on
+ * /diagnostics_agg/bond, and all watch the one heartbeat the aggregator sends
+ * on /diagnostics_agg/bond_heartbeat, like the add_analyzers script with
+ * --shared-bond. See BondTracker.
+ *
+ * If "publisher_rate_limit" is greater than 0, each publisher of /diagnostics,
+ * by caller ID, may send that many messages per second on average, in bursts of
+ * up to "publisher_burst" messages. Messages over the limit are dropped before
+ * they are analyzed. Drops are counted by publisher, in statuses, in the
+ * "Publishers" status of /diagnostics_agg/stats. Publishers that stopped
+ * sending for a minute are forgotten.
+ *
+ * If "fair_queuing" is true, the default, messages are queued by publisher and
+ * the queue of each shard is served in turn by publisher, in the shard's own
+ * thread even if there is only one. The /diagnostics callback then only
+ * queues, so a publisher flooding the topic can't fill the subscriber queue
+ * and starve the others. When a shard queue is full, the oldest message of the
+ * publisher with the most queued is dropped. If false, with one shard and no
+ * priority lanes, statuses are analyzed in the callback as they arrive.
+ *
+ * If "priority_lanes" is true, the shards analyze in their own threads even
+ * if there is only one. Statuses that aren't OK, or whose level differs from
+ * the level of the current item with that name, are queued in a high priority
+ * lane. It is analyzed before the other queued statuses, so errors aren't
+ * delayed by a backlog of OK statuses, and is also served in turn by
+ * publisher, so one publisher's errors can't starve another's. Queued
+ * statuses that are older than one analyzed from the high priority lane are
+ * skipped.
+ *
+ * If "fast_escalation" is true, an item whose level rises above OK, and above
+ * its level when the output was last published, triggers a publish right away
+ * instead of at the next pub_rate tick. These extra publishes are
+ * at least "escalation_min_interval" seconds apart. The periodic publish is
+ * unchanged, so recoveries to OK are still published at pub_rate. Only the
+ * levels of the incoming statuses are checked, so a level raised by an analyzer,
+ * like a ThresholdAnalyzer on a value of an OK status, waits for the next tick.
+ *
+ * If "publish_events" is true, every level transition of an incoming status
+ * is published on /diagnostics_agg/events as it is analyzed, as a
+ * StatusEventArray. Each StatusEvent is one transition: the status name,
+ * previous and new level, message and update time. A status seen for the
+ * first time transitions from stale.
+ *
+ * The aggregator keeps the latest item of each status name it received, for
+ * events, history and snapshots. Items that weren't updated for "item_max_age"
+ * seconds are forgotten, along with their history. Analyzers keep their own
+ * items.
+ *
+ * If "history_size" is greater than 0, each item keeps its last history_size
+ * changes of level or message. The GetStatusHistory service
+ * /diagnostics_agg/get_history returns them for a status name, or for all
+ * names with a given prefix.
+ *
+ * If "publish_subtrees" is true, the output of each top-level analyzer is also
+ * published on its own topic, /diagnostics_agg/sub/NAME, where NAME is the
+ * first part of the path after the base path, with characters that aren't
+ * allowed in topic names replaced by '_'. If two subtrees get the same NAME,
+ * like "Power Systems" and "Power_Systems", a warning is logged and the later
+ * one gets NAME_2. Subtrees without subscribers are skipped, and the topics of
+ * subtrees that are no longer in the output are unadvertised. The full
+ * /diagnostics_agg topic can be turned off with "publish_full", if all
+ * consumers use subtree topics.
+ *
+ * If "cache_serialization" is true, the serialized bytes of each status on
+ * /diagnostics_agg are kept, and reused while the version of the item it was
+ * made from doesn't change. Headers are serialized again on every publish.
  */
 class Aggregator
 { 
@@ -117,6 +236,14 @@ public:
    */
   void publishData();
 
+  /*!
+   *\brief Publishes data now if an item escalated since the last publish.
+   *
+   * Does nothing unless fast_escalation is set. Can be called as often as
+   * needed, it is rate limited by escalation_min_interval.
+   */
+  void publishEscalations();
+
   /*!
    *\brief True if the NodeHandle reports OK
    */
@@ -128,18 +255,162 @@ public:
   double getPubRate() const { return pub_rate_; }
 
 private:
+  friend class AggregatorTest; /**< Fixture of the unit tests, reaches the shards */
+
   ros::NodeHandle n_;
   ros::ServiceServer add_srv_; /**< AddDiagnostics, /diagnostics_agg/add_diagnostics */
+  ros::ServiceServer history_srv_; /**< GetStatusHistory, /diagnostics_agg/get_history */
+  ros::ServiceServer reload_srv_; /**< ReloadAnalyzers, /diagnostics_agg/reload */
   ros::Subscriber diag_sub_; /**< DiagnosticArray, /diagnostics */
   ros::Publisher agg_pub_;  /**< DiagnosticArray, /diagnostics_agg */
   ros::Publisher toplevel_state_pub_;  /**< DiagnosticStatus, /diagnostics_toplevel_state */
-  boost::mutex mutex_;
+  ros::Publisher stats_pub_;  /**< DiagnosticArray, /diagnostics_agg/stats */
+  ros::Publisher delta_pub_;  /**< DiagnosticArray, /diagnostics_agg/delta */
+  ros::Publisher events_pub_;  /**< StatusEventArray, /diagnostics_agg/events */
+  boost::mutex mutex_; /**< Guards bonds_, serializes replacing the analyzer trees */
   double pub_rate_;
 
+  /*!
+   *\brief Statuses of one incoming message that hash to the same shard
+   */
+  struct ShardWork
+  {
+    diagnostic_msgs::DiagnosticArray::ConstPtr msg;
+    std::vector<unsigned int> indices;
+    std::string publisher; /**< Caller ID of the publisher of msg */
+    uint64_t seq; /**< Order in which the work was received */
+    bool urgent; /**< In the high priority lane */
+
+    ShardWork() : seq(0), urgent(false) { }
+  };
+
+  /*!
+   *\brief Work queued by publisher, served one message of each publisher in turn
+   */
+  struct WorkQueue
+  {
+    WorkQueue() : size(0) { }
+
+    std::map<std::string, std::deque<ShardWork> > queues; /**< Work by publisher */
+    std::deque<std::string> ready; /**< Publishers with queued work, served in turn */
+    unsigned int size; /**< Work in all queues */
+
+    void push(const ShardWork &work);
+
+    /*!
+     *\brief Removes the next work of the publisher whose turn it is. Queue must not be empty
+     */
+    ShardWork pop();
+
+    /*!
+     *\brief Drops the oldest work of the publisher with the most. Queue must not be empty
+     *
+     *\return The dropped work
+     */
+    ShardWork dropOldest();
+  };
+
+  /*!
+   *\brief Analyzers for a subset of the status names, with their own lock.
+   *
+   * If there is more than one shard, each shard analyzes its queue in its own thread.
+   */
+  struct Shard
+  {
+    Shard() : other_analyzer(NULL), escalated(false) { }
+
+    /*!
+     *\brief Current analyzer tree. Replaced, never modified, once the aggregator runs.
+     *
+     * Read with currentTree(), and replaced with boost::atomic_store under mutex_.
+     */
+    boost::shared_ptr<AnalyzerGroup> analyzer_group;
+    OtherAnalyzer* other_analyzer;
+    std::map<std::string, boost::shared_ptr<StatusItem> > items; /**< Latest item of each status name, see pruneItems() */
+    boost::shared_ptr<HistoryMessages> history_messages; /**< Messages of the item histories */
+    bool escalated; /**< An item level went up since the last check */
+    boost::mutex mutex; /**< Guards the analyzers of the tree, other_analyzer, items and their histories */
+    std::map<std::string, int8_t> published_levels; /**< Levels above OK of the items at the last publish, guarded by mutex */
+
+    /*!
+     *\brief Level of each of items, kept with priority lanes
+     *
+     * diagCallback() compares incoming statuses with these levels to pick the
+     * urgent ones. They have their own lock, so the callback doesn't wait for
+     * the shard to finish analyzing.
+     */
+    std::map<std::string, int8_t> levels;
+    boost::mutex levels_mutex; /**< Guards levels */
+
+    WorkQueue urgent; /**< High priority lane, served before queue */
+    std::map<std::string, uint64_t> urgent_seqs; /**< seq of the last urgent work by status name, guarded by mutex */
+    WorkQueue queue;
+    boost::mutex queue_mutex; /**< Guards urgent and queue */
+    boost::condition_variable queue_cond;
+    boost::thread thread;
+  };
+
+  std::vector<boost::shared_ptr<Shard> > shards_;
+  boost::atomic<bool> shutdown_; /**< Tells shard threads to exit, read under each shard's queue_mutex */
+
+  /*!
+   *\brief Current analyzer tree of a shard, which stays valid while the pointer is held
+   */
+  static boost::shared_ptr<AnalyzerGroup> currentTree(const Shard &shard);
+
+  /*!
+   *\brief Returns the index of the shard that handles a status name
+   */
+  unsigned int shardIndex(const std::string &name) const;
+
+  /*!
+   *\brief Updates the items of the statuses of work, and analyzes them.
+   * Caller must hold shard.mutex
+   *
+   * Statuses older than urgent work already analyzed for the same name are skipped.
+   *
+   *\param events : Level transitions are appended to it, if not NULL
+   */
+  void analyzeStatuses(Shard &shard, const ShardWork &work,
+                       StatusEventArray *events);
+
+  bool priority_lanes_; /**< Queue statuses that aren't OK or changed level ahead of others */
+  bool fair_queuing_; /**< Queue by publisher and analyze in shard threads, even with one shard */
+  uint64_t next_seq_; /**< seq of the next ShardWork */
+
+  /*!
+   *\brief True if the shards analyze in their own threads, instead of in diagCallback
+   */
+  bool threaded() const { return shards_.size() > 1 || priority_lanes_ || fair_queuing_; }
+
+  /*!
+   *\brief Analyzes one item, or gives it to the OtherAnalyzer. Caller must hold shard.mutex
+   */
+  void analyzeItem(Shard &shard, const boost::shared_ptr<StatusItem> &item);
+
+  /*!
+   *\brief Queues work for a shard thread, in its lane. If the lane has too much
+   * work, drops the oldest work of the publisher with the most in that lane.
+   * Caller must hold shard.queue_mutex
+   */
+  void queueWork(Shard &shard, const ShardWork &work);
+
+  /*!
+   *\brief Thread function of a shard, analyzes its queue until shutdown
+   */
+  void shardThread(Shard *shard);
+
+  /*!
+   *\brief Clears the escalated flag of a shard, and returns its previous value
+   */
+  bool checkEscalated(Shard &shard);
+
   /*!
    *\brief Callback for incoming "/diagnostics"
    */
-  void diagCallback(const diagnostic_msgs::DiagnosticArray::ConstPtr& diag_msg);
+  void diagCallback(const ros::MessageEvent<diagnostic_msgs::DiagnosticArray const> &event);
+
+  boost::shared_ptr<PublisherLimiter> limiter_; /**< Rate limits and drop counts by publisher */
 
   /*!
    *\brief Service request callback for addition of diagnostics.
@@ -150,32 +421,62 @@ private:
   bool addDiagnostics(diagnostic_msgs::AddDiagnostics::Request &req,
 		      diagnostic_msgs::AddDiagnostics::Response &res);
 
-  AnalyzerGroup* analyzer_group_;
-
-  OtherAnalyzer* other_analyzer_;
-
   std::vector<boost::shared_ptr<bond::Bond> > bonds_; /**< \brief Contains all bonds for additional diagnostics. */
+  boost::shared_ptr<BondTracker> bond_tracker_; /**< \brief Bonds on one topic instead of bonds_, if multiplex_bonds is set */
 
   /*
    *!\brief called when a bond between the aggregator and a node is broken
    *
-   * Modifies the contents of added_analyzers_ and analyzer_group, removing the
-   * diagnostics that had been brought up by that bond.
+   * Replaces the analyzer tree of each shard by a copy without the diagnostics
+   * that had been brought up by that bond.
    *!\param bond_id The bond id (namespace) from which the analyzer was created
-   *!\param analyzer Shared pointer to the analyzer group that was added
+   *!\param groups Shared pointers to the analyzer groups that were added, one per shard
    */
   void bondBroken(std::string bond_id,
-		  boost::shared_ptr<Analyzer> analyzer);
+		  std::vector<boost::shared_ptr<Analyzer> > groups);
 
   /*
    *!\brief called when a bond is formed between the aggregator and a node.
-   * Actually adds the analyzergroup to the main analyzer group. Before this
-   * function is called, the added diagnostics will not be analyzed by the
-   * aggregator.
-   *!\param group Shared pointer to the analyzer group that is to be added,
-   *  which was created in the addDiagnostics function
+   * Actually adds the analyzergroup to a copy of the analyzer tree of each shard,
+   * which then replaces it. Before this function is called, the added diagnostics
+   * will not be analyzed by the aggregator.
+   *!\param groups Shared pointers to the analyzer groups that are to be added,
+   *  one per shard, which were created in the addDiagnostics function
    */
-  void bondFormed(boost::shared_ptr<Analyzer> group);
+  void bondFormed(std::vector<boost::shared_ptr<Analyzer> > groups);
+
+  bool other_as_errors_; /**< \brief Passed to the OtherAnalyzer of each shard */
+
+  /*
+   *!\brief Service request callback to reload the analyzers from the parameters
+   */
+  bool reloadAnalyzers(diagnostic_aggregator::ReloadAnalyzers::Request &req,
+                       diagnostic_aggregator::ReloadAnalyzers::Response &res);
+
+  /*
+   *!\brief Hash of the base path and the analyzer parameters, for the snapshot match cache
+   */
+  uint64_t configHash(const ros::NodeHandle &nh) const;
+
+  int history_size_; /**< \brief Number of changes kept per item, 0 if disabled */
+
+  /*
+   *!\brief Service request callback for the history of items
+   */
+  bool getHistory(diagnostic_aggregator::GetStatusHistory::Request &req,
+                  diagnostic_aggregator::GetStatusHistory::Response &res);
+
+  /*
+   *!\brief Starts the history of a new item, if enabled. Caller must hold shard.mutex
+   */
+  void initHistory(Shard &shard, StatusItem &item);
+
+  double item_max_age_; /**< \brief Items not updated for this long are forgotten, 0 to keep them */
+
+  /*
+   *!\brief Forgets the items of all shards that weren't updated for item_max_age_
+   */
+  void pruneItems(const ros::Time &now);
 
   std::string base_path_; /**< \brief Prepended to all status names of aggregator. */
 
@@ -186,6 +487,127 @@ private:
    */
   void checkTimestamp(const diagnostic_msgs::DiagnosticArray::ConstPtr& diag_msg);
 
+  /*
+   *!\brief Publishes the aggregator's own statistics, if there are any
+   */
+  void publishStats();
+
+  /*!
+   *\brief Merges the reports of several shards in deterministic order
+   *
+   * Headers reported by several shards are recomputed from their merged children,
+   * and their number of children is checked against expected_items.
+   *
+   *\param expected_items : Number of items expected under each header, see Analyzer::getExpectedItems()
+   */
+  static std::vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > mergeShardReports(
+    const std::vector<std::vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > > &reports,
+    const std::map<std::string, int> &expected_items);
+
+  /*!
+   *\brief Reports all shards into the aggregated array and toplevel state
+   *
+   * With fast_escalation, also records the item levels that escalations are
+   * compared with, so it is only called to publish.
+   *
+   *\param statuses : The statuses of diag_array, as reported by the analyzers
+   */
+  void buildOutput(diagnostic_msgs::DiagnosticArray &diag_array,
+                   std::vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > &statuses,
+                   diagnostic_msgs::DiagnosticStatus &diag_toplevel_state);
+
+  /*!
+   *\brief Publishes the aggregated array, delta and toplevel state. Caller must hold publish_mutex_
+   */
+  void publishOutput(const diagnostic_msgs::DiagnosticArray &diag_array,
+                     const std::vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > &statuses,
+                     const diagnostic_msgs::DiagnosticStatus &diag_toplevel_state);
+
+  bool publish_deltas_; /**< \brief Publish changed statuses on /diagnostics_agg/delta */
+  double delta_full_period_; /**< \brief Period of full arrays on the delta topic */
+  ros::Time last_full_delta_;
+  std::map<std::string, diagnostic_msgs::DiagnosticStatus> last_published_; /**< \brief Last delta state, by name */
+
+  /*
+   *!\brief Publishes the statuses that changed since the last call
+   *
+   * Every delta_full_period, all statuses are published, so consumers can
+   * recover from lost messages and drop items that are gone.
+   */
+  void publishDelta(const diagnostic_msgs::DiagnosticArray &diag_array);
+
+  bool publish_events_; /**< \brief Publish level transitions on /diagnostics_agg/events */
+
+  bool publish_full_; /**< \brief Publish on /diagnostics_agg */
+  bool publish_subtrees_; /**< \brief Publish each top-level subtree on /diagnostics_agg/sub/NAME */
+  std::map<std::string, ros::Publisher> subtree_pubs_; /**< \brief Subtree publishers, by subtree name */
+
+  /*
+   *!\brief Publishes the statuses of each subtree that has subscribers on its own topic
+   */
+  void publishSubtrees(const diagnostic_msgs::DiagnosticArray &diag_array);
+
+  /*
+   *!\brief Returns the topic for a new subtree, /diagnostics_agg/sub/NAME
+   *
+   * If another subtree already has that topic, a number is added, NAME_2, NAME_3...
+   */
+  std::string subtreeTopic(const std::string &subtree) const;
+
+  bool cache_serialization_; /**< \brief Publish /diagnostics_agg from serialized_cache_ */
+  SerializedStatusCache serialized_cache_; /**< \brief Guarded by publish_mutex_ */
+
+  /*
+   *!\brief Appends the level transition of item to events
+   */
+  static void addEvent(const StatusItem &item, StatusEventArray &events);
+
+  /*
+   *!\brief True if events are enabled and someone listens to them
+   */
+  bool eventsWanted() const { return publish_events_ && events_pub_.getNumSubscribers() > 0; }
+
+  /*
+   *!\brief Publishes events on /diagnostics_agg/events, if there are any
+   */
+  void publishEvents(const StatusEventArray &events);
+
+  std::string snapshot_file_; /**< \brief Snapshot of the latest items, empty if disabled */
+  double snapshot_period_;
+  double snapshot_max_age_; /**< \brief Items older than this aren't kept in the snapshot */
+  uint64_t config_hash_; /**< \brief Hash of the analyzer parameters, for the snapshot match cache. Guarded by publish_mutex_ */
+  ros::Time last_snapshot_;
+
+  boost::thread snapshot_thread_;
+  boost::mutex snapshot_mutex_; /**< \brief Guards the pending snapshot */
+  boost::condition_variable snapshot_cond_;
+  std::vector<SnapshotItem> snapshot_items_; /**< \brief Pending snapshot, for the snapshot thread */
+  uint64_t snapshot_hash_; /**< \brief config_hash_ of the pending snapshot */
+  bool snapshot_pending_;
+
+  /*
+   *!\brief Copies the latest items and their match results, for the snapshot thread to write
+   *
+   * Replaces the pending snapshot, if the thread didn't write it yet.
+   */
+  void writeSnapshotFile();
+
+  /*
+   *!\brief Thread function writing the pending snapshots to snapshot_file_, until shutdown
+   */
+  void snapshotThread();
+
+  /*
+   *!\brief Loads snapshot_file_, if any, and analyzes its items as if they just arrived
+   */
+  void restoreSnapshotFile();
+
+  boost::mutex publish_mutex_; /**< \brief Guards publishing and the escalation state */
+  bool fast_escalation_; /**< \brief Publish as soon as an item escalates */
+  double escalation_min_interval_;
+  bool escalation_pending_;
+  ros::Time last_publish_;
+
 };
 
 /*
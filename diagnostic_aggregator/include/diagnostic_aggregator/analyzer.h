@@ -81,6 +81,10 @@ PATH/EtherCAT Devices
  * Since the match() function is called only when new DiagnosticStatus names arrive, the 
  * analyzers are not allowed to change which messages they want to look at. 
  *
+ * These are the version 1 functions. The AnalyzerGroup calls the version 2 functions,
+ * matchRef() and analyzeRef(), which take references instead of copies. Their default
+ * implementations call the version 1 functions, so analyzers that only implement
+ * version 1 keep working. New analyzers should derive from AnalyzerV2 instead.
  */
 class Analyzer
 {
@@ -120,6 +124,22 @@ public:
    */
   virtual bool analyze(const boost::shared_ptr<StatusItem> item) = 0;
 
+  /*!
+   *\brief Analyzes several matched items at once
+   *
+   * The AnalyzerGroup gives each analyzer all its items of an incoming
+   * message in one call. The default calls analyze() on each item, analyzers
+   * can override it to process the batch more efficiently.
+   *\param items : Array of count items, all matched by this analyzer
+   *\param analyzed : Has count elements, set to the result of analyze() for each item
+   */
+  virtual void analyzeBatch(const boost::shared_ptr<StatusItem> *items, size_t count,
+                            std::vector<bool> &analyzed)
+  {
+    for (size_t i = 0; i < count; ++i)
+      analyzed[i] = analyzeRef(items[i]);
+  }
+
   /*!
    *\brief Analysis function, output processed data.
    *
@@ -130,6 +150,14 @@ public:
    */
   virtual std::vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > report() = 0;
 
+  /*!
+   *\brief Adds the number of items expected under each reported header, by header name
+   *
+   * With several shards, each copy of an analyzer only has some of the items. The
+   * aggregator checks these counts again on the merged output. The default adds none.
+   */
+  virtual void getExpectedItems(std::map<std::string, int> &expected) const { }
+
   /*!
    *\brief Returns full prefix of analyzer. (ex: '/Robot/Sensors')
    */
@@ -140,6 +168,59 @@ public:
    */
   virtual std::string getName() const = 0;
 
+  /*!
+   *\brief Version 2 of match(). Default calls match()
+   */
+  virtual bool matchRef(const std::string &name) { return match(name); }
+
+  /*!
+   *\brief Version 2 of analyze(). Default calls analyze()
+   */
+  virtual bool analyzeRef(const boost::shared_ptr<StatusItem> &item) { return analyze(item); }
+};
+
+/*!
+ *\brief Base class of version 2 analyzers
+ *
+ * Version 2 analyzers implement matchRef(), analyzeRef(), getPathRef() and
+ * getNameRef() instead of the version 1 functions, which are implemented on
+ * top of them and return copies. They are loaded by pluginlib as an Analyzer,
+ * like version 1 analyzers.
+ */
+class AnalyzerV2 : public Analyzer
+{
+public:
+  AnalyzerV2() {}
+
+  virtual ~AnalyzerV2() {}
+
+  /*!
+   *\brief Returns true if analyzer will handle this item. See Analyzer::match()
+   */
+  virtual bool matchRef(const std::string &name) = 0;
+
+  /*!
+   *\brief Returns true if analyzer will report this item. See Analyzer::analyze()
+   */
+  virtual bool analyzeRef(const boost::shared_ptr<StatusItem> &item) = 0;
+
+  /*!
+   *\brief Returns full prefix of analyzer. (ex: '/Robot/Sensors')
+   */
+  virtual const std::string &getPathRef() const = 0;
+
+  /*!
+   *\brief Returns nice name for display. (ex: 'Sensors')
+   */
+  virtual const std::string &getNameRef() const = 0;
+
+  bool match(const std::string name) { return matchRef(name); }
+
+  bool analyze(const boost::shared_ptr<StatusItem> item) { return analyzeRef(item); }
+
+  std::string getPath() const { return getPathRef(); }
+
+  std::string getName() const { return getNameRef(); }
 };
 
 }
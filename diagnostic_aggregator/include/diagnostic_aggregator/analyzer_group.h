@@ -40,14 +40,18 @@
 #define DIAGNOSTIC_ANALYZER_GROUP_H
 
 #include <map>
+#include <list>
+#include <set>
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <utility>
 #include <ros/ros.h>
 #include <diagnostic_msgs/DiagnosticStatus.h>
 #include <diagnostic_msgs/KeyValue.h>
 #include "diagnostic_aggregator/status_item.h"
 #include <boost/shared_ptr.hpp>
+#include <boost/chrono.hpp>
 #include "XmlRpcValue.h"
 #include "diagnostic_aggregator/analyzer.h"
 #include "diagnostic_aggregator/status_item.h"
@@ -56,6 +60,23 @@
 
 namespace diagnostic_aggregator {
 
+/*!
+ *\brief Call counts and accumulated time spent in one analyzer
+ *
+ * Kept by the AnalyzerGroup for each of its sub-analyzers when
+ * "profile_analyzers" is set.
+ */
+struct AnalyzerTiming
+{
+  AnalyzerTiming() :
+    match_calls(0), analyze_calls(0), report_calls(0),
+    match_time(0), analyze_time(0), report_time(0)
+  { }
+
+  unsigned long match_calls, analyze_calls, report_calls;
+  boost::chrono::steady_clock::duration match_time, analyze_time, report_time;
+};
+
 /*!
  *\brief Allows analyzers to be grouped together, or used as sub-analyzers
  *
@@ -106,8 +127,27 @@ namespace diagnostic_aggregator {
  *
  * The Aggregator uses the AnalyzerGroup internally to load and update analyzers.
  *
+ * If the "profile_analyzers" parameter is true, the AnalyzerGroup counts the calls
+ * to match(), analyze() and report() of each sub-analyzer, and the time spent in
+ * them. The results are available from reportStats().
+ *
+ * The results of match() are cached by status name. Publishers that put IDs or
+ * times in their status names make this cache grow without bound, so the
+ * "match_cache_bytes" parameter limits its approximate size. Past the limit, the
+ * least recently used names are evicted, and will be matched again if they come
+ * back. A warning is printed when more than "match_cache_prefix_warn" new names
+ * share the same prefix, the part of the name before its first digit.
+ *
+ * If the "report_threads" parameter is greater than 1, the report() functions of
+ * the sub-analyzers are called on a pool of that many threads, and their outputs
+ * are merged in the usual order. Sub-analyzers are then reported at the same time,
+ * so their report() functions must not modify state they share with each other.
+ * StatusItem lookups like getValue() don't modify the items, and can be made
+ * from report(). If a
+ * sub-analyzer throws, report() waits for the others, then throws a
+ * std::runtime_error naming the analyzer.
  */
-class AnalyzerGroup : public Analyzer
+class AnalyzerGroup : public AnalyzerV2
 {
 public:
   AnalyzerGroup();
@@ -134,34 +174,116 @@ public:
   /*!
    *\brief Match returns true if any sub-analyzers match an item
    */
-  virtual bool match(const std::string name);
+  virtual bool matchRef(const std::string &name);
 
   /*!
    *\brief Clear match arrays. Used when analyzers are added or removed
    */
   void resetMatches();
 
+  /*!
+   *\brief New group with the same path and sub-analyzers, and no cached matches or statistics
+   *
+   * The sub-analyzers are shared with this group, not copied. Only reads what
+   * init() and addAnalyzer() set, so it can be called while another thread
+   * analyzes with this group.
+   */
+  boost::shared_ptr<AnalyzerGroup> clone() const;
+
+  /*!
+   *\brief New group with the sub-analyzers now in the "analyzers" namespace of n
+   *
+   * Sub-analyzers whose namespace and parameters are the same as when they were
+   * loaded are shared with this group, the others are loaded again. Analyzers
+   * added with addAnalyzer() are kept. Like clone(), it can be called while
+   * another thread analyzes with this group.
+   *
+   *\param loaded : Number of sub-analyzers that were loaded again
+   *\param reused : Number of sub-analyzers shared with this group
+   *\return NULL if a sub-analyzer failed to load, or there are none
+   */
+  boost::shared_ptr<AnalyzerGroup> reload(const ros::NodeHandle &n, unsigned int &loaded,
+                                          unsigned int &reused) const;
+
+  /*!
+   *\brief Takes over the cached matches of the group it was reloaded from, and analyzes items
+   *
+   * Sub-analyzers shared with previous keep their match results and their items.
+   * The others are asked to match the names cached by previous, and get the
+   * items they match. No other thread may use previous while it is called.
+   *
+   *\param matched : Set to whether any sub-analyzer matches each item
+   */
+  void takeOver(const AnalyzerGroup &previous, const std::vector<boost::shared_ptr<StatusItem> > &items,
+                std::vector<bool> &matched);
+
+  /*!
+   *\brief Cached match results for name, one per sub-analyzer. Empty if name isn't matched yet
+   */
+  std::vector<bool> getMatches(const std::string &name) const;
+
+  /*!
+   *\brief Restores match results from getMatches(), so match() doesn't ask the sub-analyzers
+   *
+   *\return False if the results don't fit the current sub-analyzers
+   */
+  bool setMatches(const std::string &name, const std::vector<bool> &matches);
+
   /*!
    *\brief Analyze returns true if any sub-analyzers will analyze an item
    */
-  virtual bool analyze(const boost::shared_ptr<StatusItem> item);
+  virtual bool analyzeRef(const boost::shared_ptr<StatusItem> &item);
+
+  /*!
+   *\brief Matches the items, and gives each sub-analyzer its matched items in one batch
+   *
+   * Unlike analyze(), the items don't need to be matched first.
+   */
+  virtual void analyzeBatch(const boost::shared_ptr<StatusItem> *items, size_t count,
+                            std::vector<bool> &analyzed);
 
   /*!
    *\brief The processed output is the combined output of the sub-analyzers, and the top level status
    */
   virtual std::vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > report();
 
-  virtual std::string getPath() const { return path_; }
+  /*!
+   *\brief Adds the expected item counts of all sub-analyzers
+   */
+  virtual void getExpectedItems(std::map<std::string, int> &expected) const;
+
+  virtual const std::string &getPathRef() const { return path_; }
+
+  virtual const std::string &getNameRef() const { return nice_name_; }
 
-  virtual std::string getName() const { return nice_name_; }
+  /*!
+   *\brief Statistics of the group itself, not part of the diagnostics output
+   *
+   * The first status, named by the path of the group, has the match cache counters.
+   * If profiling is enabled, there is also one status per sub-analyzer with call
+   * counts and time spent, named by the getPath() of that analyzer.
+   */
+  std::vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > reportStats() const;
 
 private:
   std::string path_, nice_name_;
 
   /*!
    *\brief Loads Analyzer plugins in "analyzers" namespace
+   *
+   * Shared by all AnalyzerGroups, since making a ClassLoader crawls all packages for plugins.
    */
-  pluginlib::ClassLoader<Analyzer> analyzer_loader_;
+  boost::shared_ptr<pluginlib::ClassLoader<Analyzer> > analyzer_loader_;
+
+  /*!
+   *\brief Fully qualified Analyzer class for a type, "" if unknown
+   *
+   * Types without the package name are looked up in a map of the declared classes,
+   * made on first use.
+   */
+  std::string resolveAnalyzerType(const std::string &an_type);
+
+  std::map<std::string, std::string> short_class_names_; /**< Class name without package to declared class */
 
   /*!
    *\brief These items store errors, if any, for analyzers that failed to initialize or load
@@ -170,10 +292,96 @@ private:
 
   std::vector<boost::shared_ptr<Analyzer> > analyzers_;
 
+  /*!
+   *\brief Namespace and parameters of each sub-analyzer, empty for added ones. Same order as analyzers_
+   */
+  std::vector<std::pair<std::string, std::string> > configs_;
+
+  /*!
+   *\brief getPath() and getName() of each sub-analyzer, taken when it is added,
+   * so report() doesn't copy them. Same order as analyzers_
+   */
+  std::vector<std::pair<std::string, std::string> > analyzer_names_;
+
+  /*!
+   *\brief Adds a sub-analyzer, with its config, timing and names
+   */
+  void appendAnalyzer(const boost::shared_ptr<Analyzer> &analyzer,
+                      const std::pair<std::string, std::string> &config);
+
+  /*!
+   *\brief Loads the sub-analyzers in the "analyzers" namespace of n
+   *
+   *\param previous : Sub-analyzers of this group with unchanged parameters are reused, if not NULL
+   *\param loaded : Counts the sub-analyzers that were loaded
+   *\param reused : Counts the sub-analyzers that were reused
+   */
+  bool loadAnalyzers(const ros::NodeHandle &n, const AnalyzerGroup *previous,
+                     unsigned int &loaded, unsigned int &reused);
+
+  /*!
+   *\brief Index of the sub-analyzer loaded from ns with parameters config, or -1
+   */
+  int findConfig(const std::string &ns, const std::string &config) const;
+
+  struct ReportPool;
+  struct ReportLatch;
+
+  /*!
+   *\brief Reports sub-analyzer j into output, and counts down latch if not NULL
+   *
+   * Exceptions are thrown if latch is NULL, else they are recorded in latch.
+   */
+  void reportAnalyzer(unsigned int j, std::vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > *output,
+                      ReportLatch *latch);
+
+  bool profile_; /**< Time calls into sub-analyzers. */
+
+  boost::shared_ptr<ReportPool> report_pool_; /**< NULL unless report_threads > 1 */
+  std::vector<AnalyzerTiming> timings_; /**< Same order as analyzers_ */
+
+  /*
+   *\brief Match results of one name, one per sub-analyzer
+   */
+  struct MatchEntry
+  {
+    std::string name;
+    std::vector<bool> matches;
+  };
+  typedef std::list<MatchEntry> MatchList;
+
   /*
    *\brief The map of names to matchings is stored internally.
+   *
+   * Entries are kept in match_lru_, most recently used first, for eviction.
+   */
+  std::map<std::string, MatchList::iterator> matched_;
+  MatchList match_lru_;
+
+  size_t match_cache_bytes_; /**< Approximate size of the match cache */
+  size_t max_match_cache_bytes_; /**< 0 for no limit */
+  unsigned long match_hits_, match_misses_, match_evictions_;
+
+  int prefix_warn_count_; /**< New names per prefix before warning, 0 for never */
+  std::map<std::string, std::set<size_t> > prefix_names_; /**< Hashes of the names by prefix */
+  size_t prefix_names_count_; /**< Hashes in prefix_names_ */
+  std::set<std::string> warned_prefixes_;
+
+  /*
+   *\brief Match results of name, NULL if not cached. Marks the entry as recently used.
+   */
+  std::vector<bool> *findMatches(const std::string &name);
+
+  /*
+   *\brief Adds match results to the cache, and evicts old entries past the limit
+   */
+  void insertMatches(const std::string &name, const std::vector<bool> &matches);
+
+  /*
+   *\brief Counts a name that missed the cache by prefix, if it wasn't seen before,
+   * and warns if a prefix has too many
    */
-  std::map<const std::string, std::vector<bool> > matched_;
+  void checkCardinality(const std::string &name);
 
 };
 
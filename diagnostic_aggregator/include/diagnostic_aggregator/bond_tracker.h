@@ -0,0 +1,151 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef DIAGNOSTIC_AGGREGATOR_BOND_TRACKER_H
+#define DIAGNOSTIC_AGGREGATOR_BOND_TRACKER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <ros/ros.h>
+#include <bond/Status.h>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace diagnostic_aggregator {
+
+/*!
+ *\brief Keeps the bonds of many clients with one subscriber, one publisher and one timer
+ *
+ * Clients send bond::Status heartbeats with their own ID on topic, which only
+ * the tracker subscribes to. The tracker doesn't answer each client. It sends
+ * one heartbeat per period on heartbeat_topic, with an empty ID, which all
+ * clients watch. With N clients, N + 1 heartbeats are sent per period and
+ * 2N are received, as with a topic per client, but the tracker needs no
+ * subscriber or timers per client.
+ *
+ * The timeouts are checked on a timer wheel. The wheel has one slot per
+ * tick, and goes around once per heartbeat period. Each bond is in the slot
+ * given by the hash of its ID, and its timeout is checked when its slot comes
+ * up, so the work per tick stays small however many bonds there are.
+ *
+ * A bond is formed when an active status with its ID is received, and broken
+ * when the client sends an inactive status, or nothing for heartbeat_timeout
+ * seconds, or connect_timeout seconds before it formed. Then it is removed, and
+ * its ID can be added again. A bond that times out is announced on
+ * heartbeat_topic with an inactive status with its ID.
+ *
+ * Clients break their bond if the tracker's heartbeat stops, or comes from
+ * another instance_id, when the aggregator restarted. The tracker sends an
+ * inactive heartbeat when it is destroyed, so they don't wait for the timeout.
+ * The add_analyzers script bonds this way with --shared-bond.
+ */
+class BondTracker
+{
+public:
+  /*!
+   *\brief Subscribes to the clients on topic, advertises heartbeat_topic, and starts the timer wheel
+   */
+  BondTracker(ros::NodeHandle &n, const std::string &topic, const std::string &heartbeat_topic,
+              double heartbeat_period = 1.0, double heartbeat_timeout = 4.0,
+              double connect_timeout = 10.0);
+
+  ~BondTracker();
+
+  /*!
+   *\brief Starts tracking a bond. The callbacks are called without any lock held
+   *
+   *\return False if a bond with this ID is already tracked
+   */
+  bool add(const std::string &id, const boost::function<void(void)> &on_formed,
+           const boost::function<void(void)> &on_broken);
+
+  /*!
+   *\brief True if a bond with this ID is tracked
+   */
+  bool contains(const std::string &id) const;
+
+  /*!
+   *\brief Number of bonds tracked
+   */
+  unsigned int size() const;
+
+private:
+  /*!
+   *\brief State of one bond
+   */
+  struct Client
+  {
+    Client() : formed(false), slot(0) { }
+
+    boost::function<void(void)> on_formed, on_broken;
+    bool formed;
+    std::string sister_instance_id; /**< instance_id of the client, empty until formed */
+    ros::Time last_heard; /**< Time of the last active status, or of add() */
+    unsigned int slot;
+  };
+
+  ros::Subscriber sub_;
+  ros::Publisher pub_; /**< On heartbeat_topic */
+  ros::Timer timer_;
+  std::string instance_id_; /**< Changes when the aggregator restarts */
+  double heartbeat_period_, heartbeat_timeout_, connect_timeout_;
+
+  mutable boost::mutex mutex_; /**< Guards clients_, wheel_ and next_slot_ */
+  std::map<std::string, Client> clients_;
+  std::vector<std::vector<std::string> > wheel_; /**< IDs of the bonds in each slot */
+  unsigned int next_slot_;
+
+  void statusCallback(const bond::Status::ConstPtr &msg);
+
+  /*!
+   *\brief Checks the timeouts of the bonds of the next slot, and sends the
+   * heartbeat once per turn of the wheel
+   */
+  void tick(const ros::TimerEvent &event);
+
+  /*!
+   *\brief Removes a bond from its slot and from clients_. Caller must hold mutex_
+   */
+  void remove(const std::string &id);
+
+  /*!
+   *\brief Publishes on heartbeat_topic, the heartbeat of all bonds if id is empty
+   */
+  void publishStatus(const std::string &id, bool active);
+};
+
+}
+
+#endif // DIAGNOSTIC_AGGREGATOR_BOND_TRACKER_H
@@ -148,6 +148,14 @@ inline bool getParamVals(XmlRpc::XmlRpcValue param, std::vector<std::string> &ou
  * The GenericAnalyzer can discard stale items. Use the "discard_stale" parameter to
  * remove any items that haven't updated within the timeout. This is "false" by default.
  *
+ * To notice items that slow down before they go stale, set "rate_degraded_factor".
+ * If an item updates that many times slower than it usually does, or hasn't updated
+ * for that many times its usual interval, the top-level status becomes a warning,
+ * with the message "Rate degraded". The update rates of the items are then shown in
+ * the top-level status. While an item is degraded, its usual rate adapts ten times
+ * slower, so a lasting slowdown stays a warning for a while. Default is 0, which
+ * doesn't check the rates.
+ *
  * Example configurations:
  *\verbatim
  * hokuyo:
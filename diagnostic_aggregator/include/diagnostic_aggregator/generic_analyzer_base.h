@@ -38,6 +38,7 @@
 #define GENERIC_ANALYZER_BASE_H
 
 #include <map>
+#include <limits>
 #include <ros/ros.h>
 #include <vector>
 #include <string>
@@ -59,16 +60,31 @@ namespace diagnostic_aggregator {
  * the Generic and Other Analyzers. It is a virtual class, and cannot be instantiated or loaded 
  * as a plugin. Subclasses are responsible for implementing the init() and match() functions.
  *
+ * It stays a version 1 Analyzer, so subclasses that override match() or analyze()
+ * are still called through the default matchRef() and analyzeRef().
+ *
  * The GenericAnalyzerBase holds the state of the analyzer, and tracks if items are stale, and
  * if the user has the correct number of items.
+ *
+ * If rate_degraded_factor is greater than 0, an item whose recent updates, or
+ * whose wait for the next update, are that many times slower than usual raises
+ * the top-level status to a warning, before it goes stale. The update rates of
+ * the items are then added to the values of the top-level status. While an item
+ * is degraded, its usual rate adapts slowly, see StatusItem::watchRate().
+ *
+ * The level and update time of each item at its last analyze() are kept in
+ * arrays, so the top-level status is computed without going through the items.
+ * Subclasses can keep numeric values of the items in arrays too, see addColumn().
  */
 class GenericAnalyzerBase : public Analyzer
 {
 public:
   GenericAnalyzerBase() : 
-    nice_name_(""), path_(""), timeout_(-1.0), num_items_expected_(-1),
+    nice_name_(""), path_(""), timeout_(-1.0), num_items_expected_(-1), rate_degraded_factor_(0),
     discard_stale_(false), has_initialized_(false), has_warned_(false) 
-  { }
+  {
+    report_summary_ = summarizeLevels(NULL, 0);
+  }
   
   virtual ~GenericAnalyzerBase() { items_.clear(); }
   
@@ -83,9 +99,11 @@ public:
    * Must be initialized in order to prepend the path to all outgoing status messages.
    */
   bool init(const std::string path, const std::string nice_name, 
-            double timeout = -1.0, int num_items_expected = -1, bool discard_stale = false)
+            double timeout = -1.0, int num_items_expected = -1, bool discard_stale = false,
+            double rate_degraded_factor = 0)
   {
     num_items_expected_ = num_items_expected;
+    rate_degraded_factor_ = rate_degraded_factor;
     timeout_ = timeout;
     nice_name_ = nice_name;
     path_ = path;
@@ -116,7 +134,9 @@ public:
     if (!has_initialized_)
       return false;
 
-    items_[item->getName()] = item;
+    setItem(item->getName(), item);
+    if (rate_degraded_factor_ > 0)
+      item->watchRate(rate_degraded_factor_);
 
     return has_initialized_;
   }
@@ -147,44 +167,59 @@ public:
     std::vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > processed;
     processed.push_back(header_status);
     
-    bool all_stale = true;
+    bool rate_degraded = false;
+    ros::Time now = ros::Time::now();
+    double now_sec = now.toSec();
 
-    std::map<std::string, boost::shared_ptr<StatusItem> >::iterator it = items_.begin();
-    while(it != items_.end())
+    // Erase items that are stale if we're discarding items
+    if (discard_stale_ && timeout_ > 0)
     {
-      std::string name = it->first;
-      boost::shared_ptr<StatusItem> item = it->second;
-
-      bool stale = false;
-      if (timeout_ > 0)
-        stale = (ros::Time::now() - item->getLastUpdateTime()).toSec() > timeout_;
-
-      // Erase item if its stale and we're discarding items
-      if (discard_stale_ and stale)
+      for (unsigned int slot = 0; slot < items_.size(); )
       {
-        items_.erase(it++);
-        continue;
+        if (now_sec - update_times_[slot] > timeout_)
+          removeSlot(slot);
+        else
+          ++slot;
       }
+    }
+
+    // Stale items count as stale whatever their level
+    report_stale_.resize(items_.size());
+    report_levels_.resize(items_.size());
+    for (unsigned int slot = 0; slot < items_.size(); ++slot)
+    {
+      report_stale_[slot] = timeout_ > 0 && now_sec - update_times_[slot] > timeout_;
+      report_levels_[slot] = report_stale_[slot] ? int8_t(Level_Stale) : levels_[slot];
+    }
+
+    report_summary_ = summarizeLevels(report_levels_.empty() ? NULL : &report_levels_[0], report_levels_.size());
+    header_status->level = report_summary_.max_level;
+    bool all_stale = report_summary_.all_stale;
+
+    for (ItemIndex::const_iterator it = item_index_.begin(); it != item_index_.end(); ++it)
+    {
+      const std::string &name = it->first;
+      const boost::shared_ptr<StatusItem> &item = items_[it->second];
+      bool stale = report_stale_[it->second];
       
-      int8_t level = item->getLevel();
-      header_status->level = std::max(header_status->level, level);
-      
+      bool raised = raised_[it->second];
       diagnostic_msgs::KeyValue kv;
       kv.key = name;
-      kv.value = item->getMessage();
+      kv.value = raised ? raised_messages_[it->second] : item->getMessage();
       
       header_status->values.push_back(kv);
-      
-      all_stale = all_stale && ((level == 3) || stale);
-      
-      //boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> stat = item->toStatusMsg(path_, stale);
-      
-      processed.push_back(item->toStatusMsg(path_, stale));
-
-      if (stale)
-        header_status->level = 3;
 
-      ++it;
+      if (rate_degraded_factor_ > 0 && !stale)
+      {
+        bool degraded = item->isRateDegraded(rate_degraded_factor_, now);
+        rate_degraded = rate_degraded || degraded;
+        header_status->values.push_back(rateValue(name, *item, degraded));
+      }
+      
+      if (raised)
+        processed.push_back(item->toStatusMsg(path_, stale, levels_[it->second], raised_messages_[it->second]));
+      else
+        processed.push_back(item->toStatusMsg(path_, stale));
     }
     
     // Header is not stale unless all subs are
@@ -194,6 +229,12 @@ public:
       header_status->level = 2;
     
     header_status->message = valToMsg(header_status->level);
+
+    if (rate_degraded && header_status->level == 0)
+    {
+      header_status->level = 1;
+      header_status->message = "Rate degraded";
+    }
     
     // If we expect a given number of items, check that we have this number
     if (num_items_expected_ == 0 && items_.size() == 0)
@@ -219,6 +260,15 @@ public:
     return processed;
   }
 
+  /*!
+   *\brief Expects num_items under the header, if set
+   */
+  virtual void getExpectedItems(std::map<std::string, int> &expected) const
+  {
+    if (num_items_expected_ > 0)
+      expected[path_] = num_items_expected_;
+  }
+
   /*!
    *\brief Match function isn't implemented by GenericAnalyzerBase
    */
@@ -240,17 +290,176 @@ protected:
 
   double timeout_;
   int num_items_expected_;
+  double rate_degraded_factor_; /**< 0 to not check update rates */
 
   /*!
    *\brief Subclasses can add items to analyze 
    */
-  void addItem(std::string name, boost::shared_ptr<StatusItem> item)  { items_[name] = item; }
+  void addItem(std::string name, boost::shared_ptr<StatusItem> item)  { setItem(name, item); }
+
+  /*!
+   *\brief True if report() removes the items that are stale
+   */
+  bool getDiscardStale() const { return discard_stale_; }
+
+  /*!
+   *\brief Level to report for an item, by default its own
+   *
+   * Called when the item is analyzed. Subclasses can return a higher level,
+   * with a message, to report the item with them. The item itself isn't
+   * changed, as other analyzers share it.
+   */
+  virtual int8_t raisedLevel(const StatusItem &item, std::string &message) const { return item.getLevel(); }
+
+  /*!
+   *\brief Keeps the numeric values of key of the items in an array, indexed by slot
+   *
+   * Values are taken when the items are analyzed, NaN if missing or not a number.
+   *
+   *\return Column of the values, for getColumn()
+   */
+  unsigned int addColumn(const std::string &key)
+  {
+    column_keys_.push_back(key);
+    columns_.push_back(std::vector<double>(items_.size(), std::numeric_limits<double>::quiet_NaN()));
+    for (unsigned int slot = 0; slot < items_.size(); ++slot)
+      columns_.back()[slot] = numericValue(*items_[slot], key);
+    return columns_.size() - 1;
+  }
+
+  /*!
+   *\brief Values of the key of a column, by slot
+   */
+  const std::vector<double> &getColumn(unsigned int column) const { return columns_[column]; }
+
+  /*!
+   *\brief True for the slots that were stale at the last report(), of the slots left after it
+   */
+  const std::vector<char> &getReportStale() const { return report_stale_; }
+
+  /*!
+   *\brief Levels of the slots at the last report(), Level_Stale for the stale ones
+   */
+  const std::vector<int8_t> &getReportLevels() const { return report_levels_; }
+
+  /*!
+   *\brief Summary of getReportLevels()
+   */
+  const LevelSummary &getReportSummary() const { return report_summary_; }
 
 private:
   /*!
-   *\brief Stores items by name. State of analyzer
+   *\brief Header value with the recent and usual update rates of an item
    */
-  std::map<std::string, boost::shared_ptr<StatusItem> > items_;
+  static diagnostic_msgs::KeyValue rateValue(const std::string &name, const StatusItem &item, bool degraded)
+  {
+    std::stringstream rate;
+    rate.precision(3);
+    if (item.getUsualInterval() > 0)
+    {
+      rate << (item.getRecentInterval() > 0 ? 1.0 / item.getRecentInterval() : 0.0) << " Hz, usually "
+           << 1.0 / item.getUsualInterval() << " Hz";
+      if (degraded)
+        rate << ", degraded";
+    }
+    else
+      rate << "Unknown";
+
+    diagnostic_msgs::KeyValue kv;
+    kv.key = name + " rate";
+    kv.value = rate.str();
+    return kv;
+  }
+
+  static double numericValue(const StatusItem &item, const std::string &key)
+  {
+    double value;
+    if (!item.getNumericValue(key, value))
+      return std::numeric_limits<double>::quiet_NaN();
+    return value;
+  }
+
+  /*!
+   *\brief Stores items by name, and takes their level, update time and column values
+   */
+  void setItem(const std::string &name, const boost::shared_ptr<StatusItem> &item)
+  {
+    ItemIndex::iterator it = item_index_.find(name);
+    if (it == item_index_.end())
+    {
+      it = item_index_.insert(std::make_pair(name, (unsigned int)items_.size())).first;
+      items_.push_back(item);
+      levels_.push_back(Level_Stale);
+      update_times_.push_back(0);
+      raised_.push_back(false);
+      raised_messages_.push_back(std::string());
+      entries_.push_back(it);
+      for (unsigned int k = 0; k < columns_.size(); ++k)
+        columns_[k].push_back(0);
+    }
+
+    unsigned int slot = it->second;
+    items_[slot] = item;
+    levels_[slot] = raisedLevel(*item, raised_messages_[slot]);
+    raised_[slot] = levels_[slot] > item->getLevel();
+    if (!raised_[slot])
+      raised_messages_[slot].clear();
+    update_times_[slot] = item->getLastUpdateTime().toSec();
+    for (unsigned int k = 0; k < columns_.size(); ++k)
+      columns_[k][slot] = numericValue(*item, column_keys_[k]);
+  }
+
+  /*!
+   *\brief Removes an item, the last slot is moved into its place
+   */
+  void removeSlot(unsigned int slot)
+  {
+    unsigned int last = items_.size() - 1;
+    item_index_.erase(entries_[slot]);
+    if (slot != last)
+    {
+      items_[slot] = items_[last];
+      levels_[slot] = levels_[last];
+      update_times_[slot] = update_times_[last];
+      raised_[slot] = raised_[last];
+      raised_messages_[slot].swap(raised_messages_[last]);
+      entries_[slot] = entries_[last];
+      entries_[slot]->second = slot;
+      for (unsigned int k = 0; k < columns_.size(); ++k)
+        columns_[k][slot] = columns_[k][last];
+    }
+
+    items_.pop_back();
+    levels_.pop_back();
+    update_times_.pop_back();
+    raised_.pop_back();
+    raised_messages_.pop_back();
+    entries_.pop_back();
+    for (unsigned int k = 0; k < columns_.size(); ++k)
+      columns_[k].pop_back();
+  }
+
+  /*!
+   *\brief Slot of each item by name. State of analyzer
+   *
+   * The item of a slot, and its level and update time at its last analyze(),
+   * are in the arrays below at that index.
+   */
+  typedef std::map<std::string, unsigned int> ItemIndex;
+  ItemIndex item_index_;
+  std::vector<boost::shared_ptr<StatusItem> > items_;
+  std::vector<int8_t> levels_;
+  std::vector<double> update_times_; /**< In seconds */
+  std::vector<char> raised_; /**< True if raisedLevel() raised the level in levels_ */
+  std::vector<std::string> raised_messages_; /**< Message of the raised levels */
+  std::vector<ItemIndex::iterator> entries_; /**< Entry of each slot in item_index_ */
+  std::vector<std::string> column_keys_;
+  std::vector<std::vector<double> > columns_; /**< Values of column_keys_, by slot. See addColumn() */
+
+  // Staleness and levels counting it, kept to not allocate each report()
+  std::vector<char> report_stale_;
+  std::vector<int8_t> report_levels_;
+  LevelSummary report_summary_;
 
   bool discard_stale_, has_initialized_, has_warned_;
 };
@@ -64,7 +64,7 @@ namespace diagnostic_aggregator {
  *
  *
  */
-class IgnoreAnalyzer : public Analyzer
+class IgnoreAnalyzer : public AnalyzerV2
 {
 public:
   /*!
@@ -76,17 +76,20 @@ public:
 
   bool init(const std::string base_name, const ros::NodeHandle &n);
 
-  bool match(const std::string name) { return false; }
+  bool matchRef(const std::string &name) { return false; }
 
-  bool analyze(boost::shared_ptr<StatusItem> item) { return false; }
+  bool analyzeRef(const boost::shared_ptr<StatusItem> &item) { return false; }
 
   /*
    *\brief Always reports an empty vector
    */
   virtual std::vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > report();
 
-  std::string getPath() const { return ""; }
-  std::string getName() const { return ""; }
+  const std::string &getPathRef() const { return empty_; }
+  const std::string &getNameRef() const { return empty_; }
+
+private:
+  std::string empty_;
 };
 
 }
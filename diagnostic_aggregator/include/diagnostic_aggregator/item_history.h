@@ -0,0 +1,143 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef DIAGNOSTIC_AGGREGATOR_ITEM_HISTORY_H
+#define DIAGNOSTIC_AGGREGATOR_ITEM_HISTORY_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+#include <ros/ros.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace diagnostic_aggregator {
+
+/*!
+ *\brief Deduplicated messages of ItemHistory entries, by key
+ *
+ * The key of a message is its hash, or the next free one if another message
+ * has that hash. Messages are reference counted, and removed once no history
+ * entry uses them. After such removals, a message may be stored under two
+ * keys, which only costs memory. Thread safe, since an item, and its history,
+ * can be destroyed by whichever thread drops the last reference to it.
+ */
+class HistoryMessages : boost::noncopyable
+{
+public:
+  /*!
+   *\brief Adds a reference to message, returns its key
+   */
+  size_t add(const std::string &message);
+
+  /*!
+   *\brief Removes a reference to the message with that key
+   */
+  void release(size_t key);
+
+  /*!
+   *\brief Returns the message with that key, "" if unknown
+   *
+   * The message stays valid while the caller holds a reference to key.
+   */
+  const std::string &get(size_t key) const;
+
+  /*!
+   *\brief Number of distinct messages stored
+   */
+  size_t size() const;
+
+private:
+  struct Entry
+  {
+    std::string message;
+    unsigned int refs;
+  };
+
+  std::map<size_t, Entry> entries_;
+  mutable boost::mutex mutex_;
+};
+
+/*!
+ *\brief Fixed size ring of the recent changes of a StatusItem
+ *
+ * An entry (update time, level, message key) is recorded when the level or
+ * the message of the item changes, so items that don't change keep their
+ * history for a long time. When the ring is full, the oldest entry is
+ * dropped. Entries are stored as parallel arrays, and the messages in a
+ * HistoryMessages table shared with other items.
+ */
+class ItemHistory : boost::noncopyable
+{
+public:
+  /*!
+   *\param capacity : Maximum number of entries, must be > 0
+   *\param messages : Table of messages, shared with other histories
+   */
+  ItemHistory(unsigned int capacity, const boost::shared_ptr<HistoryMessages> &messages);
+
+  ~ItemHistory();
+
+  /*!
+   *\brief Records an entry, unless level and message are the same as the last one
+   */
+  void add(const ros::Time &stamp, int8_t level, const std::string &message);
+
+  /*!
+   *\brief Number of entries
+   */
+  unsigned int size() const { return count_; }
+
+  /*!
+   *\brief Appends the entries to stamps, levels and messages, oldest first
+   */
+  void get(std::vector<ros::Time> &stamps, std::vector<int8_t> &levels,
+           std::vector<std::string> &messages) const;
+
+private:
+  boost::shared_ptr<HistoryMessages> messages_;
+  unsigned int capacity_;
+  unsigned int next_; /**< Index of the next entry to write */
+  unsigned int count_;
+
+  std::vector<ros::Time> stamps_;
+  std::vector<int8_t> levels_;
+  std::vector<size_t> keys_;
+};
+
+}
+
+#endif //DIAGNOSTIC_AGGREGATOR_ITEM_HISTORY_H
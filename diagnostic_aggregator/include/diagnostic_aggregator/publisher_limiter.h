@@ -0,0 +1,105 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef DIAGNOSTIC_AGGREGATOR_PUBLISHER_LIMITER_H
+#define DIAGNOSTIC_AGGREGATOR_PUBLISHER_LIMITER_H
+
+#include <map>
+#include <string>
+#include <stdint.h>
+#include <ros/ros.h>
+#include <diagnostic_msgs/DiagnosticStatus.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace diagnostic_aggregator {
+
+/*!
+ *\brief Limits the rate of incoming messages of each publisher, and counts drops
+ *
+ * Each publisher, by caller ID, has a token bucket that fills at "rate" tokens
+ * per second up to "burst" tokens. A message takes a token, and is dropped if
+ * there's none. A rate of 0 doesn't limit, but drops counted with countDropped()
+ * are still reported. Accepted and dropped statuses are counted, since a part
+ * of a message can be dropped on its own.
+ *
+ * A publisher that sent nothing for idle_timeout, and at least long enough
+ * for its bucket to fill, is forgotten by report(), so publishers that come
+ * and go don't make the buckets grow without bound.
+ */
+class PublisherLimiter
+{
+public:
+  PublisherLimiter(double rate = 0, double burst = 10, double idle_timeout = 60);
+
+  /*!
+   *\brief True if a message of publisher is accepted, counts its statuses as dropped otherwise
+   */
+  bool allow(const std::string &publisher, unsigned int statuses);
+
+  /*!
+   *\brief Counts statuses of publisher dropped for another reason, like a full queue
+   */
+  void countDropped(const std::string &publisher, unsigned int statuses);
+
+  /*!
+   *\brief Accepted and dropped statuses of each publisher that dropped any
+   *
+   * Warns if any status was dropped since the last call. Forgets idle publishers.
+   */
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> report(const std::string &name);
+
+private:
+  /*!
+   *\brief Token bucket and counters of one publisher
+   */
+  struct Bucket
+  {
+    Bucket() : tokens(0), accepted(0), dropped(0) { }
+
+    double tokens;
+    ros::WallTime last_fill; /**< Also the time of the last message */
+    uint64_t accepted, dropped; /**< Statuses */
+  };
+
+  double rate_, burst_;
+  double idle_timeout_; /**< Publishers idle for longer, and until their bucket is full, are forgotten */
+  boost::mutex mutex_; /**< Guards the buckets and counters */
+  std::map<std::string, Bucket> buckets_;
+  uint64_t reported_dropped_; /**< Drops of the current publishers at the last report() */
+};
+
+}
+
+#endif // DIAGNOSTIC_AGGREGATOR_PUBLISHER_LIMITER_H
@@ -0,0 +1,173 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef DIAGNOSTIC_AGGREGATOR_SERIALIZED_STATUS_CACHE_H
+#define DIAGNOSTIC_AGGREGATOR_SERIALIZED_STATUS_CACHE_H
+
+#include <map>
+#include <deque>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include <ros/ros.h>
+#include <ros/serialization.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <diagnostic_msgs/DiagnosticStatus.h>
+#include <boost/shared_ptr.hpp>
+#include "diagnostic_aggregator/status_item.h"
+
+namespace diagnostic_aggregator {
+
+/*!
+ *\brief True if both statuses have the same name, level, message, hardware ID and values
+ */
+bool sameStatus(const diagnostic_msgs::DiagnosticStatus &a, const diagnostic_msgs::DiagnosticStatus &b);
+
+/*!
+ *\brief DiagnosticArray made of already serialized statuses
+ *
+ * Published as a diagnostic_msgs/DiagnosticArray, the statuses are written
+ * by copying their bytes. Can't be deserialized, it is only meant to be published.
+ */
+struct CachedDiagnosticArray
+{
+  std_msgs::Header header;
+  std::vector<const std::vector<uint8_t> *> statuses; /**< Serialized statuses, owned by a SerializedStatusCache */
+};
+
+/*!
+ *\brief Keeps the serialized bytes of each status of the aggregated output
+ *
+ * Statuses made by StatusItem::toStatusMsg() from the same version of an item,
+ * with the same name, staleness and overridden level and message as in the
+ * previous array, are not
+ * serialized again. Other statuses, like the headers, are always serialized.
+ * Statuses that are gone from the array are dropped from the cache.
+ */
+class SerializedStatusCache
+{
+public:
+  SerializedStatusCache();
+
+  /*!
+   *\brief Fills out with the serialized statuses
+   *
+   * The fragments of out are valid until the next call.
+   */
+  void build(const std_msgs::Header &header,
+             const std::vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > &statuses,
+             CachedDiagnosticArray &out);
+
+  unsigned long getEncoded() const { return encoded_; }
+  unsigned long getReused() const { return reused_; }
+
+private:
+  struct Entry
+  {
+    Entry() : generation(0), version(0), stale(false), override_hash(0) { }
+
+    std::vector<uint8_t> bytes;
+    uint32_t generation; /**< Last build() that used this entry */
+    uint64_t version; /**< StatusMsgSource of the encoded status, 0 if it had none */
+    bool stale;
+    size_t override_hash;
+  };
+
+  static void encode(const diagnostic_msgs::DiagnosticStatus &status, std::vector<uint8_t> &bytes);
+
+  std::map<std::string, Entry> entries_;
+  std::deque<std::vector<uint8_t> > duplicates_; /**< Statuses whose name was already in the array */
+  uint32_t generation_;
+  unsigned long encoded_, reused_;
+};
+
+}
+
+namespace ros
+{
+namespace message_traits
+{
+
+template<> struct MD5Sum<diagnostic_aggregator::CachedDiagnosticArray>
+{
+  static const char* value() { return MD5Sum<diagnostic_msgs::DiagnosticArray>::value(); }
+  static const char* value(const diagnostic_aggregator::CachedDiagnosticArray&) { return value(); }
+};
+
+template<> struct DataType<diagnostic_aggregator::CachedDiagnosticArray>
+{
+  static const char* value() { return DataType<diagnostic_msgs::DiagnosticArray>::value(); }
+  static const char* value(const diagnostic_aggregator::CachedDiagnosticArray&) { return value(); }
+};
+
+template<> struct Definition<diagnostic_aggregator::CachedDiagnosticArray>
+{
+  static const char* value() { return Definition<diagnostic_msgs::DiagnosticArray>::value(); }
+  static const char* value(const diagnostic_aggregator::CachedDiagnosticArray&) { return value(); }
+};
+
+}
+
+namespace serialization
+{
+
+template<> struct Serializer<diagnostic_aggregator::CachedDiagnosticArray>
+{
+  template<typename Stream>
+  inline static void write(Stream& stream, const diagnostic_aggregator::CachedDiagnosticArray& m)
+  {
+    stream.next(m.header);
+    stream.next((uint32_t)m.statuses.size());
+    for (size_t i = 0; i < m.statuses.size(); ++i)
+    {
+      const std::vector<uint8_t> &bytes = *m.statuses[i];
+      if (!bytes.empty())
+        memcpy(stream.advance(bytes.size()), &bytes[0], bytes.size());
+    }
+  }
+
+  inline static uint32_t serializedLength(const diagnostic_aggregator::CachedDiagnosticArray& m)
+  {
+    uint32_t size = serializationLength(m.header) + 4;
+    for (size_t i = 0; i < m.statuses.size(); ++i)
+      size += m.statuses[i]->size();
+    return size;
+  }
+};
+
+}
+}
+
+#endif // DIAGNOSTIC_AGGREGATOR_SERIALIZED_STATUS_CACHE_H
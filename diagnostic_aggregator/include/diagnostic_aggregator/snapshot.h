@@ -0,0 +1,85 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef DIAGNOSTIC_AGGREGATOR_SNAPSHOT_H
+#define DIAGNOSTIC_AGGREGATOR_SNAPSHOT_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#include "diagnostic_aggregator/status_item.h"
+
+namespace diagnostic_aggregator {
+
+/*!
+ *\brief One item of an aggregator snapshot, with its cached match results
+ */
+struct SnapshotItem
+{
+  boost::shared_ptr<StatusItem> item;
+  std::vector<bool> matches; /**< From AnalyzerGroup::getMatches(), may be empty */
+};
+
+/*!
+ *\brief Hash of an analyzer configuration, for writeSnapshot() and readSnapshot()
+ *
+ * Unlike boost::hash, it is the same for every build, so it can be kept in files.
+ */
+uint64_t snapshotConfigHash(const std::string &config);
+
+/*!
+ *\brief Writes items to a binary snapshot file
+ *
+ * The file is written next to path, synced to disk and renamed, so a crash
+ * never leaves a partial snapshot behind.
+ *\param config_hash : Identifies the analyzer configuration the matches belong to
+ *\return False if the file couldn't be written
+ */
+bool writeSnapshot(const std::string &path, uint64_t config_hash,
+                   const std::vector<SnapshotItem> &items);
+
+/*!
+ *\brief Reads a snapshot written by writeSnapshot()
+ *
+ * Match results are only returned if the snapshot has the same config_hash.
+ * Item update times are the ones of the snapshot.
+ *\return False if the file doesn't exist or isn't a valid snapshot
+ */
+bool readSnapshot(const std::string &path, uint64_t config_hash,
+                  std::vector<SnapshotItem> &items);
+
+}
+
+#endif // DIAGNOSTIC_AGGREGATOR_SNAPSHOT_H
@@ -0,0 +1,98 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef DIAGNOSTIC_AGGREGATOR_STATISTICS_ANALYZER_H
+#define DIAGNOSTIC_AGGREGATOR_STATISTICS_ANALYZER_H
+
+#include <string>
+#include <vector>
+#include <ros/ros.h>
+#include <boost/shared_ptr.hpp>
+#include <pluginlib/class_list_macros.hpp>
+#include <diagnostic_msgs/DiagnosticStatus.h>
+#include "diagnostic_aggregator/generic_analyzer.h"
+#include "diagnostic_aggregator/status_item.h"
+
+namespace diagnostic_aggregator {
+
+/*!
+ *\brief StatisticsAnalyzer is a GenericAnalyzer that summarizes numeric values of its items
+ *
+ * StatisticsAnalyzer takes all the parameters of a GenericAnalyzer, and a list of
+ * keys. For each key, the minimum, maximum and mean of the values of the matched
+ * items, and the number of items that have it, are added to the KeyValues of the
+ * header status. The number of items at each level is added too.
+ *
+ *\verbatim
+ * motors:
+ *   type: diagnostic_aggregator/StatisticsAnalyzer
+ *   path: Motors
+ *   startswith: [ 'Motor' ]
+ *   statistics: [ 'Temperature', 'Current' ]
+ *\endverbatim
+ * Values that are missing or not numbers are left out. Items that are stale
+ * according to "timeout" are left out of the statistics, but counted as stale.
+ * With "discard_stale", they are removed, like the items of a GenericAnalyzer.
+ *
+ * The values of each key are kept in one array, indexed by item slot of the
+ * GenericAnalyzerBase, so report() only walks contiguous arrays.
+ */
+class StatisticsAnalyzer : public GenericAnalyzer
+{
+public:
+  /*!
+   *\brief Default constructor loaded by pluginlib
+   */
+  StatisticsAnalyzer();
+
+  virtual ~StatisticsAnalyzer();
+
+  /*!
+   *\brief Initializes the GenericAnalyzer parameters and the keys to summarize
+   */
+  bool init(const std::string base_path, const ros::NodeHandle &n);
+
+  /*!
+   *\brief Reports like GenericAnalyzer, with the statistics on the header
+   */
+  virtual std::vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > report();
+
+private:
+  std::vector<std::string> keys_;
+  std::vector<unsigned int> columns_; /**< Column of the values of each key */
+};
+
+}
+
+#endif // DIAGNOSTIC_AGGREGATOR_STATISTICS_ANALYZER_H
@@ -41,11 +41,14 @@
 
 #include <map>
 #include <string>
+#include <algorithm>
 #include <vector>
+#include <stdint.h>
 #include <ros/ros.h>
 #include <diagnostic_msgs/DiagnosticStatus.h>
 #include <diagnostic_msgs/KeyValue.h>
 #include <boost/shared_ptr.hpp>
+#include "diagnostic_aggregator/item_history.h"
 
 namespace diagnostic_aggregator {
 
@@ -113,6 +116,45 @@ inline std::string valToMsg(const int val)
   return "Error";
 }
 
+/*!
+ *\brief Highest level, whether all are stale, and number of each level, of some levels
+ */
+struct LevelSummary
+{
+  int8_t max_level; /**< OK if there are no levels */
+  bool all_stale; /**< True if there are no levels */
+  unsigned int counts[4]; /**< Number of levels OK, Warn, Error and Stale. Other levels aren't counted */
+};
+
+/*!
+ *\brief Summarizes an array of levels in one pass over it, without branches
+ */
+inline LevelSummary summarizeLevels(const int8_t *levels, size_t count)
+{
+  // One sum per level, so the loop has no branch or indexed store
+  int8_t max_level = Level_OK;
+  unsigned int ok = 0, warn = 0, error = 0, stale = 0;
+  for (size_t i = 0; i < count; ++i)
+  {
+    int8_t level = levels[i];
+    max_level = level > max_level ? level : max_level;
+    ok += level == Level_OK;
+    warn += level == Level_Warn;
+    error += level == Level_Error;
+    stale += level == Level_Stale;
+  }
+
+  LevelSummary summary;
+  summary.max_level = max_level;
+  summary.all_stale = stale == count;
+  summary.counts[Level_OK] = ok;
+  summary.counts[Level_Warn] = warn;
+  summary.counts[Level_Error] = error;
+  summary.counts[Level_Stale] = stale;
+
+  return summary;
+}
+
 /*!
  *\brief Removes redundant prefixes from status name.
  *
@@ -148,6 +190,22 @@ inline std::string removeLeadingNameChaff(const std::string &input_name, const s
   return output_name;
 }
 
+/*!
+ *\brief Deleter of the statuses made by StatusItem::toStatusMsg()
+ *
+ * Tells which content of the item a status was made from. It is found with
+ * boost::get_deleter<StatusMsgSource>() on the status, and is NULL for
+ * statuses made otherwise, like the headers of the analyzers.
+ */
+struct StatusMsgSource
+{
+  uint64_t version; /**< StatusItem::getVersion() of the item */
+  bool stale; /**< Made stale by toStatusMsg() */
+  size_t override_hash; /**< Hash of the level and message reported instead of the item's, 0 if none */
+
+  void operator()(diagnostic_msgs::DiagnosticStatus *status) const { delete status; }
+};
+
 /*!
  *\brief Helper class to hold, store DiagnosticStatus messages
  *
@@ -163,6 +221,11 @@ public:
    */
   StatusItem(const diagnostic_msgs::DiagnosticStatus *status);
 
+  /*!
+   *\brief Constructed from const DiagnosticStatus*, last updated at update_time
+   */
+  StatusItem(const diagnostic_msgs::DiagnosticStatus *status, const ros::Time &update_time);
+
    /*!
    *\brief Constructed from string of item name
    */
@@ -172,6 +235,11 @@ public:
 
   /*!
    *\brief Must have same name as original status or it won't update.
+   *
+   * If the content of status is the same as the current content, only the
+   * update time changes. The values aren't copied, and the cached lookups of
+   * the values stay valid. Contents are compared when their hashes are equal.
+   * The version changes when the content changes.
    * 
    *\return True if update successful, false if error
    */
@@ -185,51 +253,112 @@ public:
    * Example: Item with name "Hokuyo" toStatusMsg("Base Path/My Path", false) 
    * gives "Base Path/My Path/Hokuyo". 
    *
+   * The status is deleted by a StatusMsgSource with the version of the item.
+   * Analyzers that change the status afterwards, like GenericAnalyzer removing
+   * chaff from the name, must change it the same way for the same version.
+   *
    *\param path : Prepended to name
    *\param stale : If true, status level is 3
    */
   boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> toStatusMsg(const std::string &path, const bool stale = false) const;
 
+  /*!
+   *\brief Like toStatusMsg(), with another level and message than the item's
+   *
+   * For analyzers that report the item differently without changing it, as
+   * other analyzers share it. The level and message are hashed into the
+   * StatusMsgSource. A stale status is still Level_Stale.
+   */
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> toStatusMsg(const std::string &path, bool stale,
+                                                                   int8_t level, const std::string &message) const;
+
+  /*!
+   *\brief Converts item back to the DiagnosticStatus it was made from, with its original name
+   */
+  diagnostic_msgs::DiagnosticStatus toRawStatusMsg() const;
+
   /*
    *\brief Returns level of DiagnosticStatus message
    */
   DiagnosticLevel getLevel() const { return level_; }
 
+  /*!
+   *\brief Returns level before the last update(). Stale if never updated.
+   */
+  DiagnosticLevel getPreviousLevel() const { return previous_level_; }
+
+  /*!
+   *\brief Changes when the level, message, hardware ID or values change
+   *
+   * Versions come from one counter shared by all items, so two items never
+   * have the same version.
+   */
+  uint64_t getVersion() const { return version_; }
+
+  /*!
+   *\brief Average time between the last few updates, in seconds. 0 until updated twice
+   */
+  double getRecentInterval() const { return recent_interval_; }
+
+  /*!
+   *\brief Average time between updates over a longer run, in seconds. 0 until updated twice
+   */
+  double getUsualInterval() const { return usual_interval_; }
+
+  /*!
+   *\brief True if the recent interval, or the time since the last update, is over factor times the usual interval
+   */
+  bool isRateDegraded(double factor, const ros::Time &now) const;
+
+  /*!
+   *\brief Tells the item that an analyzer checks its rate with factor
+   *
+   * The smallest factor is kept. While the item is rate degraded by it, the
+   * usual interval adapts ten times slower, so a slowdown isn't soon taken
+   * as the usual rate.
+   */
+  void watchRate(double factor);
+
   /*!
    *\brief Get message field of DiagnosticStatus 
    */
-  std::string getMessage() const { return message_; }
+  const std::string &getMessage() const { return message_; }
 
   /*!
    *\brief Returns name of DiagnosticStatus message
    */
-  std::string getName() const { return name_; }
+  const std::string &getName() const { return name_; }
 
   /*!
    *\brief Returns hardware ID field of DiagnosticStatus message
    */
-  std::string getHwId() const { return hw_id_; }
+  const std::string &getHwId() const { return hw_id_; }
 
   /*!
    *\brief Returns the time since last update for this item
    */
-  const ros::Time getLastUpdateTime() const { return update_time_; }
+  const ros::Time &getLastUpdateTime() const { return update_time_; }
+
+  /*!
+   *\brief Starts recording the changes of this item in a ItemHistory
+   *
+   * The current state is the first entry.
+   *\param capacity : Number of changes kept
+   *\param messages : Message table of the history, shared with other items
+   */
+  void enableHistory(unsigned int capacity, const boost::shared_ptr<HistoryMessages> &messages);
+
+  /*!
+   *\brief Returns the history of this item, NULL if not enabled
+   */
+  const ItemHistory *getHistory() const { return history_.get(); }
 
   /*!
    *\brief Returns true if item has key in values KeyValues
    *
    *\return True if has key
    */
-  bool hasKey(const std::string &key) const
-  {
-    for (unsigned int i = 0; i < values_.size(); ++i)
-    {
-      if (values_[i].key == key)
-        return true;
-    }
-
-    return false;
-  }
+  bool hasKey(const std::string &key) const { return findKey(key) >= 0; }
 
   /*!
    *\brief Returns value for given key, "" if doens't exist
@@ -238,24 +367,67 @@ public:
    */
   std::string getValue(const std::string &key) const
   {
-    for (unsigned int i = 0; i < values_.size(); ++i)
-    {
-      if (values_[i].key == key)
-        return values_[i].value;
-    }
+    int i = findKey(key);
+    if (i < 0)
+      return std::string("");
 
-    return std::string("");
+    return values_[i].value;
   }
 
+  /*!
+   *\brief Returns the index of key in the KeyValues, -1 if it doesn't exist
+   *
+   * The first KeyValue with that key is found. Items with many values are
+   * searched through a sorted index, built when the values change.
+   */
+  int findKey(const std::string &key) const;
+
+  /*!
+   *\brief Gets the value for key as a number
+   *
+   * Values are parsed when they change, so lookups don't modify the item and
+   * can be made from several threads at once. A value is a number if it starts with a finite decimal number,
+   * with '.' as decimal point, followed by nothing or by whitespace, ex: "80.5"
+   * or "80.5 C". "inf", "nan" and hexadecimal numbers aren't numbers.
+   *\return False if key isn't present or its value isn't a number
+   */
+  bool getNumericValue(const std::string &key, double &value) const;
+
 private:
   ros::Time update_time_;
 
   DiagnosticLevel level_;
+  DiagnosticLevel previous_level_;
   std::string output_name_; /**< name_ w/o "/" */
   std::string name_;
   std::string message_;
   std::string hw_id_;
   std::vector<diagnostic_msgs::KeyValue> values_;
+  size_t content_hash_; /**< Hash of level_, message_, hw_id_ and values_ */
+  uint64_t version_;
+  float recent_interval_, usual_interval_; /**< Moving averages of the time between updates */
+  float watch_factor_; /**< Smallest factor given to watchRate(), 0 if none */
+
+  /*!
+   *\brief Hash of the level, message, hardware ID and values of status
+   */
+  static size_t hashContent(const diagnostic_msgs::DiagnosticStatus &status);
+
+  /*!
+   *\brief True if status has the same level, message, hardware ID and values as this item
+   */
+  bool sameContent(const diagnostic_msgs::DiagnosticStatus &status) const;
+
+  /*!
+   *\brief Builds key_index_ and parses the numeric values, after values_ changed
+   */
+  void indexValues();
+
+  std::vector<unsigned int> key_index_; /**< Indices of values_, sorted by key. Empty for few values */
+  std::vector<double> numeric_values_; /**< Parsed values_ */
+  std::vector<int8_t> numeric_valid_; /**< 1 if the value of the same index is a number */
+
+  boost::shared_ptr<ItemHistory> history_;
 };
 
 }
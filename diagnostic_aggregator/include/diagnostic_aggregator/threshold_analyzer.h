@@ -0,0 +1,116 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef DIAGNOSTIC_AGGREGATOR_THRESHOLD_ANALYZER_H
+#define DIAGNOSTIC_AGGREGATOR_THRESHOLD_ANALYZER_H
+
+#include <string>
+#include <vector>
+#include <ros/ros.h>
+#include <boost/shared_ptr.hpp>
+#include <pluginlib/class_list_macros.hpp>
+#include "diagnostic_aggregator/generic_analyzer.h"
+#include "diagnostic_aggregator/status_item.h"
+
+namespace diagnostic_aggregator {
+
+/*!
+ *\brief ThresholdAnalyzer is a GenericAnalyzer that raises item levels on numeric values
+ *
+ * ThresholdAnalyzer takes all the parameters of a GenericAnalyzer, and a list of
+ * threshold rules. Each rule checks one key of the values of the matched items.
+ * If the value crosses a threshold, the item is reported with the level of that
+ * threshold and a message describing it, unless its own level is already higher.
+ * The item itself keeps its level, it is only reported with the raised one.
+ * Values that are missing or not numbers are ignored.
+ *
+ *\verbatim
+ * motors:
+ *   type: diagnostic_aggregator/ThresholdAnalyzer
+ *   path: Motors
+ *   startswith: [ 'Motor' ]
+ *   thresholds:
+ *     - key: Temperature
+ *       warn_above: 70.0
+ *       error_above: 80.0
+ *     - key: Voltage
+ *       error_below: 11.0
+ *\endverbatim
+ * Each rule needs a "key" and at least one of "warn_above", "error_above",
+ * "warn_below" and "error_below". The rules are parsed once, at init, and the
+ * values of each item are parsed once per update by StatusItem.
+ */
+class ThresholdAnalyzer : public GenericAnalyzer
+{
+public:
+  /*!
+   *\brief Default constructor loaded by pluginlib
+   */
+  ThresholdAnalyzer();
+
+  virtual ~ThresholdAnalyzer();
+
+  /*!
+   *\brief Initializes the GenericAnalyzer parameters and the threshold rules
+   */
+  bool init(const std::string base_path, const ros::NodeHandle &n);
+
+protected:
+  /*!
+   *\brief Level of the highest threshold the values of the item cross, if above its own
+   */
+  virtual int8_t raisedLevel(const StatusItem &item, std::string &message) const;
+
+private:
+  /*!
+   *\brief Thresholds of one key. Unset thresholds are infinite.
+   */
+  struct ThresholdRule
+  {
+    std::string key;
+    double warn_above, error_above;
+    double warn_below, error_below;
+  };
+
+  std::vector<ThresholdRule> rules_;
+
+  /*!
+   *\brief Parses one rule from the "thresholds" parameter, false if it's invalid
+   */
+  static bool parseRule(XmlRpc::XmlRpcValue &param, ThresholdRule &rule);
+};
+
+}
+
+#endif // DIAGNOSTIC_AGGREGATOR_THRESHOLD_ANALYZER_H
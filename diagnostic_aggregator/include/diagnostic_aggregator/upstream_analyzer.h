@@ -0,0 +1,123 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef DIAGNOSTIC_AGGREGATOR_UPSTREAM_ANALYZER_H
+#define DIAGNOSTIC_AGGREGATOR_UPSTREAM_ANALYZER_H
+
+#include <string>
+#include <vector>
+#include <ros/ros.h>
+#include <boost/shared_ptr.hpp>
+#include <pluginlib/class_list_macros.hpp>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <diagnostic_msgs/DiagnosticStatus.h>
+#include "diagnostic_aggregator/analyzer.h"
+#include "diagnostic_aggregator/status_item.h"
+
+namespace diagnostic_aggregator {
+
+class UpstreamCache;
+
+/*!
+ *\brief UpstreamAnalyzer reports the output of another aggregator as a subtree
+ *
+ * UpstreamAnalyzer doesn't match any items from /diagnostics. Instead, it subscribes
+ * to the aggregated output of another aggregator, for example the /diagnostics_agg of
+ * a robot, and reports it under its own path. The upstream items are not analyzed
+ * again, only the header of the subtree is computed from the top-level statuses of
+ * the upstream aggregator. This way, a base station can monitor a fleet of robots
+ * without handling every status of every robot.
+ *
+ *\verbatim
+ * robot1:
+ *   type: diagnostic_aggregator/UpstreamAnalyzer
+ *   path: Robot 1
+ *   topic: /robot1/diagnostics_agg
+ *   timeout: 5.0
+ *\endverbatim
+ * Required Parameters:
+ * - \b type This is the class name of the analyzer, used to load the correct plugin type.
+ * - \b path All upstream items will be under "Base Path/My Path".
+ * - \b topic Aggregated diagnostics topic of the upstream aggregator.
+ *
+ * Optional Parameters:
+ * - \b timeout If nothing arrives from upstream for this long, all items are stale. Default 5.0.
+ * - \b delta If true, "topic" is the delta output of an aggregator with "publish_deltas" set.
+ *   Each message only updates the items it contains. Default false.
+ * - \b delta_prune_time In delta mode, items that haven't been sent for this long are removed.
+ *   Must be longer than the "delta_full_period" of the upstream aggregator. Default 30.0.
+ *
+ * With "num_shards" set, every shard loads a copy of the analyzer. The copies share
+ * one subscription and one cache of the upstream items, so the upstream output is
+ * received and stored once.
+ */
+class UpstreamAnalyzer : public AnalyzerV2
+{
+public:
+  /*!
+   *\brief Default constructor loaded by pluginlib
+   */
+  UpstreamAnalyzer();
+
+  virtual ~UpstreamAnalyzer();
+
+  bool init(const std::string base_path, const ros::NodeHandle &n);
+
+  /*!
+   *\brief Doesn't match any items, upstream items arrive on their own topic
+   */
+  bool matchRef(const std::string &name) { return false; }
+
+  bool analyzeRef(const boost::shared_ptr<StatusItem> &item) { return false; }
+
+  /*!
+   *\brief Reports the upstream items under our path, and the subtree header
+   */
+  virtual std::vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > report();
+
+  const std::string &getPathRef() const { return path_; }
+
+  const std::string &getNameRef() const { return nice_name_; }
+
+private:
+  std::string path_, nice_name_, topic_;
+  double timeout_, delta_prune_time_;
+  bool delta_;
+
+  boost::shared_ptr<UpstreamCache> cache_; /**< Shared with the other analyzers of the same topic */
+};
+
+}
+
+#endif // DIAGNOSTIC_AGGREGATOR_UPSTREAM_ANALYZER_H
@@ -35,15 +35,40 @@
 /**! \author Kevin Watts */
 
 #include <diagnostic_aggregator/aggregator.h>
+#include <diagnostic_aggregator/snapshot.h>
+#include <boost/functional/hash.hpp>
+#include <sstream>
+#include <set>
+#include <algorithm>
+#include <cctype>
 
 using namespace std;
 using namespace diagnostic_aggregator;
 
 Aggregator::Aggregator() :
   pub_rate_(1.0),
-  analyzer_group_(NULL),
-  other_analyzer_(NULL),
-  base_path_("")
+  shutdown_(false),
+  priority_lanes_(false),
+  fair_queuing_(true),
+  next_seq_(0),
+  other_as_errors_(false),
+  history_size_(0),
+  item_max_age_(600.0),
+  base_path_(""),
+  publish_deltas_(false),
+  delta_full_period_(10.0),
+  publish_events_(false),
+  publish_full_(true),
+  publish_subtrees_(false),
+  cache_serialization_(false),
+  snapshot_period_(10.0),
+  snapshot_max_age_(60.0),
+  config_hash_(0),
+  snapshot_hash_(0),
+  snapshot_pending_(false),
+  fast_escalation_(false),
+  escalation_min_interval_(0.05),
+  escalation_pending_(false)
 {
   ros::NodeHandle nh = ros::NodeHandle("~");
   nh.param(string("base_path"), base_path_, string(""));
@@ -51,24 +76,100 @@ Aggregator::Aggregator() :
     base_path_ = "/" + base_path_;
 
   nh.param("pub_rate", pub_rate_, pub_rate_);
+  nh.param("publish_deltas", publish_deltas_, publish_deltas_);
+  nh.param("delta_full_period", delta_full_period_, delta_full_period_);
+  nh.param("publish_events", publish_events_, publish_events_);
+  nh.param("item_max_age", item_max_age_, item_max_age_);
+  nh.param("publish_full", publish_full_, publish_full_);
+  nh.param("publish_subtrees", publish_subtrees_, publish_subtrees_);
+  nh.param("cache_serialization", cache_serialization_, cache_serialization_);
+  if (!publish_full_ && !publish_subtrees_)
+    ROS_WARN("Both publish_full and publish_subtrees are false, aggregated diagnostics won't be published.");
+  nh.param("history_size", history_size_, history_size_);
+  nh.param("snapshot_file", snapshot_file_, snapshot_file_);
+  nh.param("snapshot_period", snapshot_period_, snapshot_period_);
+  nh.param("snapshot_max_age", snapshot_max_age_, snapshot_max_age_);
+  nh.param("fast_escalation", fast_escalation_, fast_escalation_);
+  nh.param("escalation_min_interval", escalation_min_interval_, escalation_min_interval_);
 
-  bool other_as_errors = false;
-  nh.param("other_as_errors", other_as_errors, false);
+  nh.param("priority_lanes", priority_lanes_, priority_lanes_);
+  nh.param("fair_queuing", fair_queuing_, fair_queuing_);
 
-  analyzer_group_ = new AnalyzerGroup();
+  double publisher_rate_limit, publisher_burst;
+  nh.param("publisher_rate_limit", publisher_rate_limit, 0.0);
+  nh.param("publisher_burst", publisher_burst, 10.0);
+  limiter_.reset(new PublisherLimiter(publisher_rate_limit, publisher_burst));
 
-  if (!analyzer_group_->init(base_path_, nh))
+  bool multiplex_bonds;
+  nh.param("multiplex_bonds", multiplex_bonds, false);
+  if (multiplex_bonds)
+    bond_tracker_.reset(new BondTracker(n_, "/diagnostics_agg/bond", "/diagnostics_agg/bond_heartbeat"));
+
+  nh.param("other_as_errors", other_as_errors_, other_as_errors_);
+
+  int num_shards;
+  nh.param("num_shards", num_shards, 1);
+  if (num_shards < 1)
+  {
+    ROS_WARN("Parameter num_shards must be at least 1, got %d. Using 1 shard.", num_shards);
+    num_shards = 1;
+  }
+
+  for (int i = 0; i < num_shards; ++i)
+  {
+    boost::shared_ptr<Shard> shard(new Shard);
+    shard->analyzer_group.reset(new AnalyzerGroup());
+
+    if (!shard->analyzer_group->init(base_path_, nh))
+    {
+      ROS_ERROR("Analyzer group for diagnostic aggregator failed to initialize!");
+    }
+
+    // Last analyzer handles remaining data
+    shard->other_analyzer = new OtherAnalyzer(other_as_errors_);
+    shard->other_analyzer->init(base_path_); // This always returns true
+
+    shard->history_messages.reset(new HistoryMessages());
+
+    shards_.push_back(shard);
+  }
+
+  if (!snapshot_file_.empty())
+  {
+    config_hash_ = configHash(nh);
+    restoreSnapshotFile();
+    snapshot_thread_ = boost::thread(boost::bind(&Aggregator::snapshotThread, this));
+  }
+
+  // Unless threaded, everything is analyzed in the callback
+  if (threaded())
   {
-    ROS_ERROR("Analyzer group for diagnostic aggregator failed to initialize!");
+    for (unsigned int i = 0; i < shards_.size(); ++i)
+      shards_[i]->thread = boost::thread(boost::bind(&Aggregator::shardThread, this, shards_[i].get()));
   }
 
-  // Last analyzer handles remaining data
-  other_analyzer_ = new OtherAnalyzer(other_as_errors);
-  other_analyzer_->init(base_path_); // This always returns true
   add_srv_ = n_.advertiseService("/diagnostics_agg/add_diagnostics", &Aggregator::addDiagnostics, this);
+  reload_srv_ = n_.advertiseService("/diagnostics_agg/reload", &Aggregator::reloadAnalyzers, this);
+  if (history_size_ > 0)
+    history_srv_ = n_.advertiseService("/diagnostics_agg/get_history", &Aggregator::getHistory, this);
   diag_sub_ = n_.subscribe("/diagnostics", 1000, &Aggregator::diagCallback, this);
-  agg_pub_ = n_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics_agg", 1);
+  if (publish_full_ && cache_serialization_)
+    agg_pub_ = n_.advertise<CachedDiagnosticArray>("/diagnostics_agg", 1);
+  else if (publish_full_)
+    agg_pub_ = n_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics_agg", 1);
   toplevel_state_pub_ = n_.advertise<diagnostic_msgs::DiagnosticStatus>("/diagnostics_toplevel_state", 1);
+  stats_pub_ = n_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics_agg/stats", 1);
+  if (publish_deltas_)
+    delta_pub_ = n_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics_agg/delta", 1);
+  if (publish_events_)
+    events_pub_ = n_.advertise<StatusEventArray>("/diagnostics_agg/events", 100);
+}
+
+uint64_t Aggregator::configHash(const ros::NodeHandle &nh) const
+{
+  XmlRpc::XmlRpcValue analyzer_params;
+  nh.getParam("analyzers", analyzer_params);
+  return snapshotConfigHash(base_path_ + analyzer_params.toXml());
 }
 
 void Aggregator::checkTimestamp(const diagnostic_msgs::DiagnosticArray::ConstPtr& diag_msg)
@@ -92,60 +193,561 @@ void Aggregator::checkTimestamp(const diagnostic_msgs::DiagnosticArray::ConstPtr
   }
 }
 
-void Aggregator::diagCallback(const diagnostic_msgs::DiagnosticArray::ConstPtr& diag_msg)
+boost::shared_ptr<AnalyzerGroup> Aggregator::currentTree(const Shard &shard)
 {
-  checkTimestamp(diag_msg);
+  return boost::atomic_load(&shard.analyzer_group);
+}
+
+unsigned int Aggregator::shardIndex(const string &name) const
+{
+  if (shards_.size() == 1)
+    return 0;
+
+  return boost::hash<string>()(name) % shards_.size();
+}
+
+void Aggregator::analyzeStatuses(Shard &shard, const ShardWork &work,
+                                 StatusEventArray *events)
+{
+  const vector<unsigned int> &indices = work.indices;
+  vector<boost::shared_ptr<StatusItem> > batch;
+  batch.reserve(indices.size());
+  vector<StatusItem *> level_changes;
+  for (unsigned int j = 0; j < indices.size(); ++j)
+  {
+    const diagnostic_msgs::DiagnosticStatus &status = work.msg->status[indices[j]];
+
+    // Urgent work jumps the queue, don't go back to what was before it
+    if (work.urgent)
+      shard.urgent_seqs[status.name] = work.seq;
+    else if (!shard.urgent_seqs.empty())
+    {
+      map<string, uint64_t>::iterator urgent = shard.urgent_seqs.find(status.name);
+      if (urgent != shard.urgent_seqs.end())
+      {
+        if (urgent->second > work.seq)
+          continue;
+        shard.urgent_seqs.erase(urgent);
+      }
+    }
+
+    boost::shared_ptr<StatusItem> item;
+    bool is_new = false;
+    map<string, boost::shared_ptr<StatusItem> >::iterator it = shard.items.find(status.name);
+    if (it == shard.items.end())
+    {
+      item.reset(new StatusItem(&status));
+      initHistory(shard, *item);
+      shard.items[status.name] = item;
+      is_new = true;
+    }
+    else
+    {
+      item = it->second;
+      item->update(&status);
+    }
+
+    if (item->getLevel() != item->getPreviousLevel() && events)
+      addEvent(*item, *events);
+
+    if (priority_lanes_ && (is_new || item->getLevel() != item->getPreviousLevel()))
+      level_changes.push_back(item.get());
+
+    // Compared with the last publish, so a level that stays up doesn't publish again
+    if (fast_escalation_ && item->getLevel() > Level_OK && !shard.escalated)
+    {
+      map<string, int8_t>::const_iterator published = shard.published_levels.find(status.name);
+      shard.escalated = published == shard.published_levels.end() || item->getLevel() > published->second;
+    }
+
+    batch.push_back(item);
+  }
+
+  if (!level_changes.empty())
+  {
+    boost::mutex::scoped_lock lock(shard.levels_mutex);
+    for (unsigned int j = 0; j < level_changes.size(); ++j)
+      shard.levels[level_changes[j]->getName()] = level_changes[j]->getLevel();
+  }
+
+  if (batch.empty())
+    return;
+
+  vector<bool> analyzed(batch.size());
+  currentTree(shard)->analyzeBatch(&batch[0], batch.size(), analyzed);
+
+  for (unsigned int j = 0; j < batch.size(); ++j)
+  {
+    if (!analyzed[j])
+      shard.other_analyzer->analyzeRef(batch[j]);
+  }
+}
+
+void Aggregator::addEvent(const StatusItem &item, StatusEventArray &events)
+{
+  StatusEvent event;
+  event.name = item.getName();
+  event.previous_level = item.getPreviousLevel();
+  event.level = item.getLevel();
+  event.message = item.getMessage();
+  event.stamp = item.getLastUpdateTime();
+
+  events.events.push_back(event);
+}
+
+void Aggregator::pruneItems(const ros::Time &now)
+{
+  if (item_max_age_ <= 0)
+    return;
+
+  for (unsigned int i = 0; i < shards_.size(); ++i)
+  {
+    Shard &shard = *shards_[i];
+    boost::mutex::scoped_lock lock(shard.mutex);
+
+    map<string, boost::shared_ptr<StatusItem> >::iterator it = shard.items.begin();
+    while (it != shard.items.end())
+    {
+      if ((now - it->second->getLastUpdateTime()).toSec() <= item_max_age_)
+      {
+        ++it;
+        continue;
+      }
+
+      shard.urgent_seqs.erase(it->first);
+      {
+        boost::mutex::scoped_lock levels_lock(shard.levels_mutex);
+        shard.levels.erase(it->first);
+      }
+      shard.items.erase(it++);
+    }
+  }
+}
+
+void Aggregator::initHistory(Shard &shard, StatusItem &item)
+{
+  if (history_size_ > 0)
+    item.enableHistory(history_size_, shard.history_messages);
+}
+
+static bool historyNameLess(const diagnostic_aggregator::StatusHistory &a,
+                            const diagnostic_aggregator::StatusHistory &b)
+{
+  return a.name < b.name;
+}
+
+bool Aggregator::getHistory(diagnostic_aggregator::GetStatusHistory::Request &req,
+                            diagnostic_aggregator::GetStatusHistory::Response &res)
+{
+  for (unsigned int i = 0; i < shards_.size(); ++i)
+  {
+    Shard &shard = *shards_[i];
+    boost::mutex::scoped_lock lock(shard.mutex);
 
+    map<string, boost::shared_ptr<StatusItem> >::const_iterator it = shard.items.lower_bound(req.name);
+    for (; it != shard.items.end(); ++it)
+    {
+      if (req.prefix ? it->first.compare(0, req.name.size(), req.name) != 0 : it->first != req.name)
+        break;
+
+      const ItemHistory *history = it->second->getHistory();
+      if (!history)
+        continue;
+
+      diagnostic_aggregator::StatusHistory msg;
+      msg.name = it->first;
+      history->get(msg.stamps, msg.levels, msg.messages);
+      res.histories.push_back(msg);
+    }
+  }
+
+  std::sort(res.histories.begin(), res.histories.end(), historyNameLess);
+  return true;
+}
+
+void Aggregator::publishEvents(const StatusEventArray &events)
+{
+  if (events.events.empty())
+    return;
+
+  events_pub_.publish(events);
+}
+
+void Aggregator::analyzeItem(Shard &shard, const boost::shared_ptr<StatusItem> &item)
+{
+  boost::shared_ptr<AnalyzerGroup> tree = currentTree(shard);
   bool analyzed = false;
-  { // lock the whole loop to ensure nothing in the analyzer group changes
-    // during it.
-    boost::mutex::scoped_lock lock(mutex_);
+  if (tree->matchRef(item->getName()))
+    analyzed = tree->analyzeRef(item);
+
+  if (!analyzed)
+    shard.other_analyzer->analyzeRef(item);
+}
+
+bool Aggregator::checkEscalated(Shard &shard)
+{
+  bool escalated = shard.escalated;
+  shard.escalated = false;
+  return escalated;
+}
+
+void Aggregator::diagCallback(const ros::MessageEvent<diagnostic_msgs::DiagnosticArray const> &event)
+{
+  const string &publisher = event.getPublisherName();
+  diagnostic_msgs::DiagnosticArray::ConstPtr diag_msg = event.getConstMessage();
+  if (!limiter_->allow(publisher, diag_msg->status.size()))
+    return;
+
+  checkTimestamp(diag_msg);
+
+  vector<ShardWork> work(shards_.size()), urgent_work;
+  if (priority_lanes_)
+  {
+    urgent_work.resize(shards_.size());
+    for (unsigned int j = 0; j < diag_msg->status.size(); ++j)
+      work[shardIndex(diag_msg->status[j].name)].indices.push_back(j);
+
+    // Compare with the levels of the current items, which are pruned with the shards
+    for (unsigned int i = 0; i < shards_.size(); ++i)
+    {
+      if (work[i].indices.empty())
+        continue;
+
+      vector<unsigned int> indices;
+      indices.swap(work[i].indices);
+
+      Shard &shard = *shards_[i];
+      boost::mutex::scoped_lock lock(shard.levels_mutex);
+      for (unsigned int k = 0; k < indices.size(); ++k)
+      {
+        const diagnostic_msgs::DiagnosticStatus &status = diag_msg->status[indices[k]];
+        bool urgent = status.level > diagnostic_msgs::DiagnosticStatus::OK;
+        if (!urgent)
+        {
+          map<string, int8_t>::const_iterator it = shard.levels.find(status.name);
+          urgent = it != shard.levels.end() && it->second != valToLevel(status.level);
+        }
+
+        (urgent ? urgent_work[i] : work[i]).indices.push_back(indices[k]);
+      }
+    }
+
+    for (unsigned int i = 0; i < urgent_work.size(); ++i)
+    {
+      urgent_work[i].urgent = true;
+      urgent_work[i].seq = next_seq_;
+      work[i].seq = next_seq_;
+    }
+    ++next_seq_;
+  }
+  else
+  {
     for (unsigned int j = 0; j < diag_msg->status.size(); ++j)
+      work[shardIndex(diag_msg->status[j].name)].indices.push_back(j);
+  }
+
+  if (!threaded())
+  {
+    // lock the whole loop to ensure nothing in the analyzer group changes
+    // during it.
+    StatusEventArray events;
+    bool escalated;
+    {
+      boost::mutex::scoped_lock lock(shards_[0]->mutex);
+      work[0].msg = diag_msg;
+      analyzeStatuses(*shards_[0], work[0], eventsWanted() ? &events : NULL);
+      escalated = checkEscalated(*shards_[0]);
+    }
+    publishEvents(events);
+
+    if (escalated)
+    {
+      {
+        boost::mutex::scoped_lock lock(publish_mutex_);
+        escalation_pending_ = true;
+      }
+      publishEscalations();
+    }
+    return;
+  }
+
+  for (unsigned int i = 0; i < shards_.size(); ++i)
+  {
+    if (work[i].indices.size() == 0)
+      continue;
+
+    work[i].msg = diag_msg;
+    work[i].publisher = publisher;
+
+    Shard &shard = *shards_[i];
+    {
+      boost::mutex::scoped_lock lock(shard.queue_mutex);
+      queueWork(shard, work[i]);
+    }
+    shard.queue_cond.notify_one();
+  }
+
+  for (unsigned int i = 0; i < urgent_work.size(); ++i)
+  {
+    if (urgent_work[i].indices.size() == 0)
+      continue;
+
+    urgent_work[i].msg = diag_msg;
+    urgent_work[i].publisher = publisher;
+
+    Shard &shard = *shards_[i];
+    {
+      boost::mutex::scoped_lock lock(shard.queue_mutex);
+      queueWork(shard, urgent_work[i]);
+    }
+    shard.queue_cond.notify_one();
+  }
+}
+
+void Aggregator::WorkQueue::push(const ShardWork &work)
+{
+  deque<ShardWork> &queue = queues[work.publisher];
+  if (queue.empty())
+    ready.push_back(work.publisher);
+  queue.push_back(work);
+  ++size;
+}
+
+Aggregator::ShardWork Aggregator::WorkQueue::pop()
+{
+  string publisher = ready.front();
+  ready.pop_front();
+  deque<ShardWork> &queue = queues[publisher];
+  ShardWork work = queue.front();
+  queue.pop_front();
+  --size;
+  if (queue.empty())
+    queues.erase(publisher);
+  else
+    ready.push_back(publisher);
+  return work;
+}
+
+Aggregator::ShardWork Aggregator::WorkQueue::dropOldest()
+{
+  map<string, deque<ShardWork> >::iterator longest = queues.begin();
+  map<string, deque<ShardWork> >::iterator it;
+  for (it = queues.begin(); it != queues.end(); ++it)
+  {
+    if (it->second.size() > longest->second.size())
+      longest = it;
+  }
+
+  ShardWork dropped = longest->second.front();
+  longest->second.pop_front();
+  --size;
+  if (longest->second.empty())
+  {
+    ready.erase(find(ready.begin(), ready.end(), dropped.publisher));
+    queues.erase(longest);
+  }
+  return dropped;
+}
+
+void Aggregator::queueWork(Shard &shard, const ShardWork &work)
+{
+  WorkQueue &queue = work.urgent ? shard.urgent : shard.queue;
+
+  // Same bound as the subscriber queue, in case a shard can't keep up
+  if (queue.size >= 1000)
+  {
+    ShardWork dropped = queue.dropOldest();
+    ROS_WARN_THROTTLE(10.0, "Diagnostic aggregator shard is falling behind%s, dropping old messages of %s.",
+                      work.urgent ? " on urgent statuses" : "", dropped.publisher.c_str());
+    limiter_->countDropped(dropped.publisher, dropped.indices.size());
+  }
+
+  queue.push(work);
+}
+
+void Aggregator::shardThread(Shard *shard)
+{
+  while (true)
+  {
+    ShardWork work;
     {
-      analyzed = false;
-      boost::shared_ptr<StatusItem> item(new StatusItem(&diag_msg->status[j]));
+      boost::mutex::scoped_lock lock(shard->queue_mutex);
+      while (shard->queue.size == 0 && shard->urgent.size == 0 && !shutdown_)
+        shard->queue_cond.wait(lock);
+
+      if (shutdown_)
+        return;
 
-      if (analyzer_group_->match(item->getName()))
-	analyzed = analyzer_group_->analyze(item);
+      // One message of each publisher in turn, urgent ones first
+      if (shard->urgent.size > 0)
+        work = shard->urgent.pop();
+      else
+        work = shard->queue.pop();
+    }
 
-      if (!analyzed)
-	other_analyzer_->analyze(item);
+    StatusEventArray events;
+    bool escalated;
+    {
+      boost::mutex::scoped_lock lock(shard->mutex);
+      analyzeStatuses(*shard, work, eventsWanted() ? &events : NULL);
+      escalated = checkEscalated(*shard);
+    }
+    publishEvents(events);
+
+    if (escalated)
+    {
+      {
+        boost::mutex::scoped_lock lock(publish_mutex_);
+        escalation_pending_ = true;
+      }
+      publishEscalations();
     }
   }
 }
 
 Aggregator::~Aggregator()
 {
-  if (analyzer_group_) delete analyzer_group_;
+  shutdown_ = true;
+
+  // Taking the lock makes sure a shard thread isn't between its check and its wait
+  for (unsigned int i = 0; i < shards_.size(); ++i)
+  {
+    boost::mutex::scoped_lock lock(shards_[i]->queue_mutex);
+    shards_[i]->queue_cond.notify_all();
+  }
+
+  for (unsigned int i = 0; i < shards_.size(); ++i)
+  {
+    Shard &shard = *shards_[i];
+    if (shard.thread.joinable())
+      shard.thread.join();
+
+    if (shard.other_analyzer) delete shard.other_analyzer;
+  }
 
-  if (other_analyzer_) delete other_analyzer_;
+  // The last pending snapshot is still written
+  {
+    boost::mutex::scoped_lock lock(snapshot_mutex_);
+    snapshot_cond_.notify_all();
+  }
+  if (snapshot_thread_.joinable())
+    snapshot_thread_.join();
 }
 
 
-void Aggregator::bondBroken(string bond_id, boost::shared_ptr<Analyzer> analyzer)
+void Aggregator::bondBroken(string bond_id, vector<boost::shared_ptr<Analyzer> > groups)
 {
   boost::mutex::scoped_lock lock(mutex_); // Possibility of multiple bonds breaking at once
   ROS_WARN("Bond for namespace %s was broken", bond_id.c_str());
-  std::vector<boost::shared_ptr<bond::Bond> >::iterator elem;
-  elem = std::find_if(bonds_.begin(), bonds_.end(), BondIDMatch(bond_id));
-  if (elem == bonds_.end()){
-    ROS_WARN("Broken bond tried to erase a bond which didn't exist.");
-  } else {
-    bonds_.erase(elem);
-  }
-  if (!analyzer_group_->removeAnalyzer(analyzer))
+  // The tracker already forgot the bond
+  if (!bond_tracker_)
   {
-    ROS_WARN("Broken bond tried to remove an analyzer which didn't exist.");
+    std::vector<boost::shared_ptr<bond::Bond> >::iterator elem;
+    elem = std::find_if(bonds_.begin(), bonds_.end(), BondIDMatch(bond_id));
+    if (elem == bonds_.end()){
+      ROS_WARN("Broken bond tried to erase a bond which didn't exist.");
+    } else {
+      bonds_.erase(elem);
+    }
   }
 
-  analyzer_group_->resetMatches();
+  // The shard threads may be analyzing with the current trees, so change copies
+  for (unsigned int i = 0; i < shards_.size(); ++i)
+  {
+    boost::shared_ptr<AnalyzerGroup> tree = currentTree(*shards_[i])->clone();
+    if (!tree->removeAnalyzer(groups[i]))
+    {
+      ROS_WARN("Broken bond tried to remove an analyzer which didn't exist.");
+    }
+
+    boost::atomic_store(&shards_[i]->analyzer_group, tree);
+  }
 }
 
-void Aggregator::bondFormed(boost::shared_ptr<Analyzer> group){
+void Aggregator::bondFormed(vector<boost::shared_ptr<Analyzer> > groups){
   ROS_DEBUG("Bond formed");
   boost::mutex::scoped_lock lock(mutex_);
-  analyzer_group_->addAnalyzer(group);
-  analyzer_group_->resetMatches();
+  for (unsigned int i = 0; i < shards_.size(); ++i)
+  {
+    boost::shared_ptr<AnalyzerGroup> tree = currentTree(*shards_[i])->clone();
+    tree->addAnalyzer(groups[i]);
+    boost::atomic_store(&shards_[i]->analyzer_group, tree);
+  }
+}
+
+bool Aggregator::reloadAnalyzers(diagnostic_aggregator::ReloadAnalyzers::Request &req,
+                                 diagnostic_aggregator::ReloadAnalyzers::Response &res)
+{
+  ros::WallTime start = ros::WallTime::now();
+  ros::NodeHandle nh = ros::NodeHandle("~");
+
+  // Keeps bonds from changing the trees while they are reloaded
+  boost::mutex::scoped_lock lock(mutex_);
+
+  // Plugins are loaded without blocking the shards. If any fails, all shards keep their trees.
+  vector<boost::shared_ptr<AnalyzerGroup> > new_trees;
+  for (unsigned int i = 0; i < shards_.size(); ++i)
+  {
+    unsigned int loaded, reused;
+    boost::shared_ptr<AnalyzerGroup> new_tree = currentTree(*shards_[i])->reload(nh, loaded, reused);
+    if (!new_tree)
+    {
+      res.message = "Failed to load the analyzers, kept the previous ones. See the aggregator log for errors.";
+      res.success = false;
+      ROS_ERROR("%s", res.message.c_str());
+      return true;
+    }
+
+    // All shards load the same analyzers
+    res.reloaded = loaded;
+    res.reused = reused;
+    new_trees.push_back(new_tree);
+  }
+
+  uint64_t config_hash = snapshot_file_.empty() ? 0 : configHash(nh);
+
+  // Snapshots are taken under publish_mutex_, they must not see the trees
+  // of one configuration with the hash of the other
+  boost::mutex::scoped_lock publish_lock(publish_mutex_);
+  for (unsigned int i = 0; i < shards_.size(); ++i)
+  {
+    Shard &shard = *shards_[i];
+    boost::shared_ptr<AnalyzerGroup> tree = currentTree(shard);
+    const boost::shared_ptr<AnalyzerGroup> &new_tree = new_trees[i];
+
+    // Only taking over its items blocks the shard
+    boost::mutex::scoped_lock shard_lock(shard.mutex);
+    vector<boost::shared_ptr<StatusItem> > items;
+    map<string, boost::shared_ptr<StatusItem> >::const_iterator it;
+    for (it = shard.items.begin(); it != shard.items.end(); ++it)
+      items.push_back(it->second);
+
+    vector<bool> matched;
+    new_tree->takeOver(*tree, items, matched);
+
+    // Items of removed analyzers are now "Other", and others may not be anymore
+    delete shard.other_analyzer;
+    shard.other_analyzer = new OtherAnalyzer(other_as_errors_);
+    shard.other_analyzer->init(base_path_);
+    for (unsigned int j = 0; j < items.size(); ++j)
+    {
+      if (!matched[j])
+        shard.other_analyzer->analyzeRef(items[j]);
+    }
+
+    boost::atomic_store(&shard.analyzer_group, new_tree);
+  }
+
+  if (!snapshot_file_.empty())
+    config_hash_ = config_hash;
+
+  stringstream message;
+  message << "Reloaded " << res.reloaded << " analyzers, kept " << res.reused << " in "
+          << (ros::WallTime::now() - start).toSec() << " s.";
+  res.message = message.str();
+  res.success = true;
+  ROS_INFO("%s", res.message.c_str());
+  return true;
 }
 
 bool Aggregator::addDiagnostics(diagnostic_msgs::AddDiagnostics::Request &req,
@@ -160,32 +762,46 @@ bool Aggregator::addDiagnostics(diagnostic_msgs::AddDiagnostics::Request &req,
     return true;
   }
 
-  boost::shared_ptr<Analyzer> group = boost::make_shared<AnalyzerGroup>();
+  // Each shard gets its own copy of the added analyzers
+  vector<boost::shared_ptr<Analyzer> > groups;
+  for (unsigned int i = 0; i < shards_.size(); ++i)
+    groups.push_back(boost::make_shared<AnalyzerGroup>());
+
   { // lock here ensures that bonds from the same namespace aren't added twice.
     // Without it, possibility of two simultaneous calls adding two objects.
     boost::mutex::scoped_lock lock(mutex_);
+    boost::function<void(void)> on_broken(boost::bind(&Aggregator::bondBroken, this, req.load_namespace, groups));
+    boost::function<void(void)> on_formed(boost::bind(&Aggregator::bondFormed, this, groups));
+
     // rebuff attempts to add things from the same namespace twice
-    if (std::find_if(bonds_.begin(), bonds_.end(), BondIDMatch(req.load_namespace)) != bonds_.end())
+    if (bond_tracker_ ? bond_tracker_->contains(req.load_namespace) :
+        std::find_if(bonds_.begin(), bonds_.end(), BondIDMatch(req.load_namespace)) != bonds_.end())
     {
       res.message = "Requested load from namespace " + req.load_namespace + " which is already in use";
       res.success = false;
       return true;
     }
 
-    // Use a different topic for each bond to help control the message queue
-    // length. Bond has a fixed size subscriber queue, so we can easily miss
-    // bond heartbeats if there are too many bonds on the same topic.
-    boost::shared_ptr<bond::Bond> req_bond = boost::make_shared<bond::Bond>(
-      "/diagnostics_agg/bond" + req.load_namespace, req.load_namespace,
-      boost::function<void(void)>(boost::bind(&Aggregator::bondBroken, this, req.load_namespace, group)),
-      boost::function<void(void)>(boost::bind(&Aggregator::bondFormed, this, group))
-									    );
-    req_bond->start();
+    if (bond_tracker_)
+      bond_tracker_->add(req.load_namespace, on_formed, on_broken);
+    else
+    {
+      // Use a different topic for each bond to help control the message queue
+      // length. Bond has a fixed size subscriber queue, so we can easily miss
+      // bond heartbeats if there are too many bonds on the same topic.
+      boost::shared_ptr<bond::Bond> req_bond = boost::make_shared<bond::Bond>(
+        "/diagnostics_agg/bond" + req.load_namespace, req.load_namespace, on_broken, on_formed);
+      req_bond->start();
 
-    bonds_.push_back(req_bond); // bond formed, keep track of it
+      bonds_.push_back(req_bond); // bond formed, keep track of it
+    }
   }
 
-  if (group->init(base_path_, ros::NodeHandle(req.load_namespace)))
+  bool init_ok = true;
+  for (unsigned int i = 0; i < groups.size(); ++i)
+    init_ok = groups[i]->init(base_path_, ros::NodeHandle(req.load_namespace)) && init_ok;
+
+  if (init_ok)
   {
     res.message = "Successfully initialised AnalyzerGroup. Waiting for bond to form.";
     res.success = true;
@@ -199,20 +815,206 @@ bool Aggregator::addDiagnostics(diagnostic_msgs::AddDiagnostics::Request &req,
   }
 }
 
-void Aggregator::publishData()
+/*!
+ *\brief True if a status is the empty header of an analyzer with no items
+ */
+static bool isEmptyStale(const diagnostic_msgs::DiagnosticStatus &status)
 {
-  diagnostic_msgs::DiagnosticArray diag_array;
+  return status.level == Level_Stale && status.values.size() == 0;
+}
 
-  diagnostic_msgs::DiagnosticStatus diag_toplevel_state;
+/*!
+ *\brief Combines the reports of several shards for the same status name
+ *
+ * Copies from shards without any items are ignored, unless all copies are
+ * like that. Values are merged by key, a "Missing" value is replaced by a
+ * value from another shard.
+ */
+static boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> combineCopies(
+  const vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > &copies)
+{
+  vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > contributing;
+  for (unsigned int i = 0; i < copies.size(); ++i)
+  {
+    if (!isEmptyStale(*copies[i]))
+      contributing.push_back(copies[i]);
+  }
+  if (contributing.size() == 0)
+    contributing = copies;
+
+  unsigned int base = 0;
+  bool all_stale = true;
+  for (unsigned int i = 0; i < contributing.size(); ++i)
+  {
+    if (contributing[i]->level > contributing[base]->level)
+      base = i;
+    all_stale = all_stale && contributing[i]->level == Level_Stale;
+  }
+
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> merged(
+    new diagnostic_msgs::DiagnosticStatus(*contributing[base]));
+
+  // Stale is an error unless all are stale
+  if (merged->level == Level_Stale && !all_stale)
+  {
+    merged->level = Level_Error;
+    merged->message = valToMsg(merged->level);
+  }
+
+  merged->values.clear();
+  map<string, unsigned int> value_index;
+  for (unsigned int i = 0; i < contributing.size(); ++i)
+  {
+    const vector<diagnostic_msgs::KeyValue> &values = contributing[i]->values;
+    for (unsigned int k = 0; k < values.size(); ++k)
+    {
+      map<string, unsigned int>::iterator it = value_index.find(values[k].key);
+      if (it == value_index.end())
+      {
+        value_index[values[k].key] = merged->values.size();
+        merged->values.push_back(values[k]);
+      }
+      else if (merged->values[it->second].value == "Missing")
+        merged->values[it->second].value = values[k].value;
+    }
+  }
+
+  return merged;
+}
+
+/*!
+ *\brief Depth of a status name in the tree, for ordering headers bottom-up
+ */
+static bool deeperName(const string &a, const string &b)
+{
+  return count(a.begin(), a.end(), '/') > count(b.begin(), b.end(), '/');
+}
+
+vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > Aggregator::mergeShardReports(
+  const vector<vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > > &reports,
+  const map<string, int> &expected_items)
+{
+  if (reports.size() == 1)
+    return reports[0];
+
+  // Names in order of first appearance, shard by shard
+  vector<string> names;
+  map<string, vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > > copies;
+  for (unsigned int i = 0; i < reports.size(); ++i)
+  {
+    for (unsigned int j = 0; j < reports[i].size(); ++j)
+    {
+      vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > &named = copies[reports[i][j]->name];
+      if (named.size() == 0)
+        names.push_back(reports[i][j]->name);
+      named.push_back(reports[i][j]);
+    }
+  }
+
+  map<string, boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > merged;
+  map<string, vector<string> > children;
+  vector<string> headers;
+  for (unsigned int i = 0; i < names.size(); ++i)
+  {
+    const vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > &named = copies[names[i]];
+    if (named.size() == 1)
+      merged[names[i]] = named[0];
+    else
+    {
+      merged[names[i]] = combineCopies(named);
+      headers.push_back(names[i]);
+    }
+
+    string::size_type last_slash = names[i].rfind("/");
+    if (last_slash != string::npos && last_slash > 0)
+      children[names[i].substr(0, last_slash)].push_back(names[i]);
+  }
+
+  // Each shard computed its headers from its own items only, and reports the
+  // items of the other shards as missing. Recompute them from the merged
+  // children only, deepest first so parent groups see the result.
+  stable_sort(headers.begin(), headers.end(), deeperName);
+  for (unsigned int i = 0; i < headers.size(); ++i)
+  {
+    const vector<string> &kids = children[headers[i]];
+    if (kids.size() == 0)
+      continue;
+
+    int8_t level = Level_OK;
+    bool all_stale = true;
+    for (unsigned int k = 0; k < kids.size(); ++k)
+    {
+      level = max(level, merged[kids[k]]->level);
+      all_stale = all_stale && merged[kids[k]]->level == Level_Stale;
+    }
+    if (level == Level_Stale && !all_stale)
+      level = Level_Error;
+
+    boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> header = merged[headers[i]];
+
+    // Each shard only counted its own items, the copies' messages are about those
+    map<string, int>::const_iterator expected = expected_items.find(headers[i]);
+    if (expected != expected_items.end())
+    {
+      header->message = valToMsg(level);
+      if (int(kids.size()) != expected->second)
+      {
+        level = max(level, int8_t(Level_Error));
+        stringstream counts;
+        counts << "Expected " << expected->second << ", found " << kids.size();
+        header->message = counts.str();
+      }
+      header->level = level;
+    }
+    else if (header->level != level)
+    {
+      header->level = level;
+      header->message = valToMsg(level);
+    }
+  }
+
+  vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > output;
+  for (unsigned int i = 0; i < names.size(); ++i)
+    output.push_back(merged[names[i]]);
+
+  return output;
+}
+
+void Aggregator::buildOutput(diagnostic_msgs::DiagnosticArray &diag_array,
+                             vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > &statuses,
+                             diagnostic_msgs::DiagnosticStatus &diag_toplevel_state)
+{
   diag_toplevel_state.name = "toplevel_state";
   diag_toplevel_state.level = -1;
   int min_level = 255;
   
-  vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > processed;
+  vector<vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > > shard_processed, shard_other;
+  map<string, int> expected_items;
+  for (unsigned int i = 0; i < shards_.size(); ++i)
   {
-    boost::mutex::scoped_lock lock(mutex_);
-    processed = analyzer_group_->report();
+    boost::mutex::scoped_lock lock(shards_[i]->mutex);
+    shard_processed.push_back(currentTree(*shards_[i])->report());
+    shard_other.push_back(shards_[i]->other_analyzer->report());
+
+    // All shards load the same analyzers
+    if (i == 0 && shards_.size() > 1)
+      currentTree(*shards_[i])->getExpectedItems(expected_items);
+
+    // Escalations are detected against the item levels of this output
+    if (fast_escalation_)
+    {
+      Shard &shard = *shards_[i];
+      shard.published_levels.clear();
+      map<string, boost::shared_ptr<StatusItem> >::const_iterator it;
+      for (it = shard.items.begin(); it != shard.items.end(); ++it)
+      {
+        if (it->second->getLevel() > Level_OK)
+          shard.published_levels[it->first] = it->second->getLevel();
+      }
+    }
   }
+
+  vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > processed = mergeShardReports(shard_processed, expected_items);
   for (unsigned int i = 0; i < processed.size(); ++i)
   {
     diag_array.status.push_back(*processed[i]);
@@ -223,7 +1025,7 @@ void Aggregator::publishData()
       min_level = processed[i]->level;
   }
 
-  vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > processed_other = other_analyzer_->report();
+  vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > processed_other = mergeShardReports(shard_other, expected_items);
   for (unsigned int i = 0; i < processed_other.size(); ++i)
   {
     diag_array.status.push_back(*processed_other[i]);
@@ -234,13 +1036,335 @@ void Aggregator::publishData()
       min_level = processed_other[i]->level;
   }
 
-  diag_array.header.stamp = ros::Time::now();
+  statuses.swap(processed);
+  statuses.insert(statuses.end(), processed_other.begin(), processed_other.end());
 
-  agg_pub_.publish(diag_array);
+  diag_array.header.stamp = ros::Time::now();
 
   // Top level is error if we have stale items, unless all stale
   if (diag_toplevel_state.level > 2 && min_level <= 2)
     diag_toplevel_state.level = 2;
+}
+
+void Aggregator::publishOutput(const diagnostic_msgs::DiagnosticArray &diag_array,
+                               const vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > &statuses,
+                               const diagnostic_msgs::DiagnosticStatus &diag_toplevel_state)
+{
+  if (publish_full_ && cache_serialization_)
+  {
+    CachedDiagnosticArray cached_array;
+    serialized_cache_.build(diag_array.header, statuses, cached_array);
+    agg_pub_.publish(cached_array);
+  }
+  else if (publish_full_)
+    agg_pub_.publish(diag_array);
+
+  if (publish_subtrees_)
+    publishSubtrees(diag_array);
+
+  if (publish_deltas_)
+    publishDelta(diag_array);
 
   toplevel_state_pub_.publish(diag_toplevel_state);
+
+  last_publish_ = diag_array.header.stamp;
+  escalation_pending_ = false;
+}
+
+string Aggregator::subtreeTopic(const string &subtree) const
+{
+  string name = subtree;
+  for (unsigned int i = 0; i < name.size(); ++i)
+  {
+    if (!isalnum((unsigned char)name[i]) && name[i] != '_')
+      name[i] = '_';
+  }
+
+  // Subtrees like "Power Systems" and "Power_Systems" have the same name once
+  // replaced, the later one gets a number
+  string topic = "/diagnostics_agg/sub/" + name;
+  for (unsigned int n = 2; ; ++n)
+  {
+    map<string, ros::Publisher>::const_iterator it;
+    for (it = subtree_pubs_.begin(); it != subtree_pubs_.end(); ++it)
+    {
+      if (it->second.getTopic() == topic)
+        break;
+    }
+    if (it == subtree_pubs_.end())
+      return topic;
+
+    if (n == 2)
+      ROS_WARN("Diagnostics subtrees %s and %s have the same topic name, %s.", it->first.c_str(),
+               subtree.c_str(), topic.c_str());
+
+    stringstream numbered;
+    numbered << "/diagnostics_agg/sub/" << name << "_" << n;
+    topic = numbered.str();
+  }
+}
+
+void Aggregator::publishSubtrees(const diagnostic_msgs::DiagnosticArray &diag_array)
+{
+  map<string, diagnostic_msgs::DiagnosticArray> subtrees;
+  set<string> present;
+  string prefix = base_path_ == "/" ? base_path_ : base_path_ + "/";
+  for (unsigned int i = 0; i < diag_array.status.size(); ++i)
+  {
+    const string &name = diag_array.status[i].name;
+    if (name.compare(0, prefix.size(), prefix) != 0)
+      continue;
+
+    // First part of the path after the base path
+    string subtree = name.substr(prefix.size(), name.find('/', prefix.size()) - prefix.size());
+    if (subtree.empty())
+      continue;
+
+    present.insert(subtree);
+
+    map<string, ros::Publisher>::iterator pub = subtree_pubs_.find(subtree);
+    if (pub == subtree_pubs_.end())
+    {
+      string topic = subtreeTopic(subtree);
+      ROS_DEBUG("Advertising diagnostics subtree %s on %s.", subtree.c_str(), topic.c_str());
+      subtree_pubs_[subtree] = n_.advertise<diagnostic_msgs::DiagnosticArray>(topic, 1);
+      continue;
+    }
+
+    if (pub->second.getNumSubscribers() == 0)
+      continue;
+
+    subtrees[subtree].status.push_back(diag_array.status[i]);
+  }
+
+  // Subtrees no longer in the output, after their analyzer is removed or reloaded
+  map<string, ros::Publisher>::iterator pub = subtree_pubs_.begin();
+  while (pub != subtree_pubs_.end())
+  {
+    if (present.count(pub->first))
+    {
+      ++pub;
+      continue;
+    }
+
+    ROS_DEBUG("Diagnostics subtree %s is gone, no longer advertising %s.", pub->first.c_str(),
+              pub->second.getTopic().c_str());
+    pub->second.shutdown();
+    subtree_pubs_.erase(pub++);
+  }
+
+  map<string, diagnostic_msgs::DiagnosticArray>::iterator it;
+  for (it = subtrees.begin(); it != subtrees.end(); ++it)
+  {
+    it->second.header = diag_array.header;
+    subtree_pubs_[it->first].publish(it->second);
+  }
+}
+
+void Aggregator::publishData()
+{
+  boost::mutex::scoped_lock lock(publish_mutex_);
+
+  diagnostic_msgs::DiagnosticArray diag_array;
+  vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > statuses;
+  diagnostic_msgs::DiagnosticStatus diag_toplevel_state;
+  buildOutput(diag_array, statuses, diag_toplevel_state);
+  publishOutput(diag_array, statuses, diag_toplevel_state);
+
+  publishStats();
+  pruneItems(diag_array.header.stamp);
+
+  if (!snapshot_file_.empty() && (diag_array.header.stamp - last_snapshot_).toSec() >= snapshot_period_)
+  {
+    last_snapshot_ = diag_array.header.stamp;
+    writeSnapshotFile();
+  }
+}
+
+void Aggregator::publishEscalations()
+{
+  if (!fast_escalation_)
+    return;
+
+  boost::mutex::scoped_lock lock(publish_mutex_);
+  if (!escalation_pending_)
+    return;
+
+  // Stays pending until the interval has passed
+  if ((ros::Time::now() - last_publish_).toSec() < escalation_min_interval_)
+    return;
+
+  ROS_DEBUG("Diagnostic level escalated, publishing aggregated diagnostics early.");
+
+  diagnostic_msgs::DiagnosticArray diag_array;
+  vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > statuses;
+  diagnostic_msgs::DiagnosticStatus diag_toplevel_state;
+  buildOutput(diag_array, statuses, diag_toplevel_state);
+  publishOutput(diag_array, statuses, diag_toplevel_state);
+}
+
+void Aggregator::writeSnapshotFile()
+{
+  ros::Time now = ros::Time::now();
+  vector<SnapshotItem> items;
+  for (unsigned int i = 0; i < shards_.size(); ++i)
+  {
+    Shard &shard = *shards_[i];
+    boost::mutex::scoped_lock lock(shard.mutex);
+    boost::shared_ptr<AnalyzerGroup> tree = currentTree(shard);
+
+    map<string, boost::shared_ptr<StatusItem> >::const_iterator it;
+    for (it = shard.items.begin(); it != shard.items.end(); ++it)
+    {
+      if ((now - it->second->getLastUpdateTime()).toSec() > snapshot_max_age_)
+        continue;
+
+      // Items are updated in place, so write a copy
+      diagnostic_msgs::DiagnosticStatus status = it->second->toRawStatusMsg();
+      SnapshotItem snap;
+      snap.item.reset(new StatusItem(&status, it->second->getLastUpdateTime()));
+      snap.matches = tree->getMatches(it->first);
+      items.push_back(snap);
+    }
+  }
+
+  {
+    boost::mutex::scoped_lock lock(snapshot_mutex_);
+    snapshot_items_.swap(items);
+    snapshot_hash_ = config_hash_;
+    snapshot_pending_ = true;
+  }
+  snapshot_cond_.notify_one();
+}
+
+void Aggregator::snapshotThread()
+{
+  while (true)
+  {
+    vector<SnapshotItem> items;
+    uint64_t config_hash;
+    {
+      boost::mutex::scoped_lock lock(snapshot_mutex_);
+      while (!snapshot_pending_ && !shutdown_)
+        snapshot_cond_.wait(lock);
+
+      if (!snapshot_pending_)
+        return;
+
+      items.swap(snapshot_items_);
+      config_hash = snapshot_hash_;
+      snapshot_pending_ = false;
+    }
+
+    writeSnapshot(snapshot_file_, config_hash, items);
+  }
+}
+
+void Aggregator::restoreSnapshotFile()
+{
+  vector<SnapshotItem> items;
+  if (!readSnapshot(snapshot_file_, config_hash_, items))
+    return;
+
+  for (unsigned int i = 0; i < items.size(); ++i)
+  {
+    Shard &shard = *shards_[shardIndex(items[i].item->getName())];
+    boost::mutex::scoped_lock lock(shard.mutex);
+
+    if (items[i].matches.size() > 0)
+      currentTree(shard)->setMatches(items[i].item->getName(), items[i].matches);
+
+    initHistory(shard, *items[i].item);
+    shard.items[items[i].item->getName()] = items[i].item;
+    analyzeItem(shard, items[i].item);
+
+    if (priority_lanes_)
+    {
+      boost::mutex::scoped_lock levels_lock(shard.levels_mutex);
+      shard.levels[items[i].item->getName()] = items[i].item->getLevel();
+    }
+  }
+
+  ROS_INFO("Restored %d diagnostic items from snapshot %s.", (int)items.size(), snapshot_file_.c_str());
+}
+
+void Aggregator::publishDelta(const diagnostic_msgs::DiagnosticArray &diag_array)
+{
+  bool full = (diag_array.header.stamp - last_full_delta_).toSec() >= delta_full_period_;
+  if (full)
+  {
+    last_full_delta_ = diag_array.header.stamp;
+    last_published_.clear();
+  }
+
+  // Sent even if nothing changed, consumers use it to tell we're alive
+  diagnostic_msgs::DiagnosticArray delta;
+  delta.header = diag_array.header;
+  for (unsigned int i = 0; i < diag_array.status.size(); ++i)
+  {
+    const diagnostic_msgs::DiagnosticStatus &status = diag_array.status[i];
+    map<string, diagnostic_msgs::DiagnosticStatus>::iterator it = last_published_.find(status.name);
+    if (it != last_published_.end() && sameStatus(it->second, status))
+      continue;
+
+    last_published_[status.name] = status;
+    delta.status.push_back(status);
+  }
+
+  delta_pub_.publish(delta);
+}
+
+void Aggregator::publishStats()
+{
+  diagnostic_msgs::DiagnosticArray stats_array;
+  for (unsigned int i = 0; i < shards_.size(); ++i)
+  {
+    vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > stats;
+    {
+      boost::mutex::scoped_lock lock(shards_[i]->mutex);
+      stats = currentTree(*shards_[i])->reportStats();
+    }
+
+    for (unsigned int j = 0; j < stats.size(); ++j)
+    {
+      // Tell the shards apart by hardware ID, the names are the analyzer paths
+      if (shards_.size() > 1)
+      {
+        stringstream shard_id;
+        shard_id << "shard " << i;
+        stats[j]->hardware_id = shard_id.str();
+      }
+      stats_array.status.push_back(*stats[j]);
+    }
+  }
+
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> publishers = limiter_->report(base_path_ + "/Publishers");
+  if (publishers->values.size() > 0)
+    stats_array.status.push_back(*publishers);
+
+  if (cache_serialization_)
+  {
+    diagnostic_msgs::DiagnosticStatus cache_status;
+    cache_status.name = base_path_ + "/Serialization cache";
+    cache_status.message = "Serialization cache";
+
+    diagnostic_msgs::KeyValue kv;
+    stringstream encoded, reused;
+    encoded << serialized_cache_.getEncoded();
+    reused << serialized_cache_.getReused();
+    kv.key = "Statuses encoded";
+    kv.value = encoded.str();
+    cache_status.values.push_back(kv);
+    kv.key = "Statuses reused";
+    kv.value = reused.str();
+    cache_status.values.push_back(kv);
+
+    stats_array.status.push_back(cache_status);
+  }
+
+  if (stats_array.status.size() == 0)
+    return;
+
+  stats_array.header.stamp = ros::Time::now();
+  stats_pub_.publish(stats_array);
 }
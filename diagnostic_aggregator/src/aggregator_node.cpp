@@ -35,6 +35,7 @@
 /**< \author Kevin Watts */
 
 #include <diagnostic_aggregator/aggregator.h>
+#include <ros/callback_queue.h>
 #include <exception>
 
 using namespace std;
@@ -47,12 +48,28 @@ int main(int argc, char **argv)
   {
   diagnostic_aggregator::Aggregator agg;
   
-  ros::Rate pub_rate(agg.getPubRate());
+  // Callbacks are handled between publishes, so escalations can be
+  // published without waiting for the next one
+  ros::Duration pub_period(1.0 / agg.getPubRate());
+  ros::Time next_pub = ros::Time::now();
   while (agg.ok())
   {
-    ros::spinOnce();
-    agg.publishData();
-    pub_rate.sleep();
+    ros::getGlobalCallbackQueue()->callAvailable(ros::WallDuration(0.01));
+    agg.publishEscalations();
+
+    ros::Time now = ros::Time::now();
+
+    // Time went backwards, ex: a bag played in a loop. Like ros::Rate, start over
+    if (now < next_pub - pub_period)
+      next_pub = now + pub_period;
+
+    if (now >= next_pub)
+    {
+      agg.publishData();
+      next_pub = next_pub + pub_period;
+      if (next_pub < now)
+        next_pub = now + pub_period;
+    }
   }
   }
   catch (exception& e)
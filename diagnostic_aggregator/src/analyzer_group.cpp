@@ -35,22 +35,138 @@
 /**! \author Kevin Watts */
 
 #include <diagnostic_aggregator/analyzer_group.h>
+#include <sstream>
+#include <stdexcept>
+#include <boost/asio/io_service.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/weak_ptr.hpp>
 
 using namespace std;
 using namespace diagnostic_aggregator;
 
+typedef boost::chrono::steady_clock SteadyClock;
+
+namespace {
+
+boost::mutex loader_mutex;
+boost::weak_ptr<pluginlib::ClassLoader<Analyzer> > shared_loader;
+
+/*
+ * Returns the ClassLoader shared by all AnalyzerGroups, making it if there's none.
+ * It is destroyed with the last AnalyzerGroup, after the analyzers it loaded.
+ */
+boost::shared_ptr<pluginlib::ClassLoader<Analyzer> > getAnalyzerLoader()
+{
+  boost::mutex::scoped_lock lock(loader_mutex);
+  boost::shared_ptr<pluginlib::ClassLoader<Analyzer> > loader = shared_loader.lock();
+  if (!loader)
+  {
+    loader.reset(new pluginlib::ClassLoader<Analyzer>("diagnostic_aggregator", "diagnostic_aggregator::Analyzer"));
+    shared_loader = loader;
+  }
+  return loader;
+}
+
+}
+
 PLUGINLIB_EXPORT_CLASS(diagnostic_aggregator::AnalyzerGroup, 
                         diagnostic_aggregator::Analyzer)
 
+/*!
+ *\brief Threads that run report() of sub-analyzers
+ */
+struct AnalyzerGroup::ReportPool
+{
+  ReportPool(int num_threads) :
+    work(new boost::asio::io_service::work(service))
+  {
+    for (int i = 0; i < num_threads; ++i)
+      threads.create_thread(boost::bind(&ReportPool::run, this));
+  }
+
+  ~ReportPool()
+  {
+    work.reset();
+    service.stop();
+    threads.join_all();
+  }
+
+  void run() { service.run(); }
+
+  boost::asio::io_service service;
+  boost::scoped_ptr<boost::asio::io_service::work> work; /**< Keeps the threads running while idle */
+  boost::thread_group threads;
+};
+
+/*!
+ *\brief Waits for a number of reports to finish, and keeps the first error
+ */
+struct AnalyzerGroup::ReportLatch
+{
+  ReportLatch(unsigned int count) : remaining(count), failed(false) { }
+
+  void countDown()
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    if (--remaining == 0)
+      cond.notify_all();
+  }
+
+  void fail(const std::string &what)
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    if (failed)
+      return;
+    failed = true;
+    error = what;
+  }
+
+  void wait()
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    while (remaining > 0)
+      cond.wait(lock);
+  }
+
+  unsigned int remaining;
+  bool failed;
+  std::string error; /**< Of the first report that failed */
+  boost::mutex mutex;
+  boost::condition_variable cond;
+};
+
 AnalyzerGroup::AnalyzerGroup() :
   path_(""),
   nice_name_(""),
-  analyzer_loader_("diagnostic_aggregator", "diagnostic_aggregator::Analyzer")
+  analyzer_loader_(getAnalyzerLoader()),
+  profile_(false),
+  match_cache_bytes_(0),
+  max_match_cache_bytes_(0),
+  match_hits_(0),
+  match_misses_(0),
+  match_evictions_(0),
+  prefix_warn_count_(1000),
+  prefix_names_count_(0)
 { }
 
 bool AnalyzerGroup::init(const string base_path, const ros::NodeHandle &n)
 {
   n.param("path", nice_name_, string(""));
+  n.param("profile_analyzers", profile_, false);
+
+  int max_cache_bytes;
+  n.param("match_cache_bytes", max_cache_bytes, 0);
+  max_match_cache_bytes_ = max_cache_bytes > 0 ? max_cache_bytes : 0;
+  n.param("match_cache_prefix_warn", prefix_warn_count_, prefix_warn_count_);
+
+  int report_threads;
+  n.param("report_threads", report_threads, 0);
+  if (report_threads > 1)
+    report_pool_.reset(new ReportPool(report_threads));
   
   if (base_path.size() > 0 && base_path != "/")
     if (nice_name_.size() > 0)
@@ -64,6 +180,13 @@ bool AnalyzerGroup::init(const string base_path, const ros::NodeHandle &n)
   if (path_.find("/") != 0)
     path_ = "/" + path_;
 
+  unsigned int loaded = 0, reused = 0;
+  return loadAnalyzers(n, NULL, loaded, reused);
+}
+
+bool AnalyzerGroup::loadAnalyzers(const ros::NodeHandle &n, const AnalyzerGroup *previous,
+                                  unsigned int &loaded, unsigned int &reused)
+{
   ros::NodeHandle analyzers_nh = ros::NodeHandle(n, "analyzers");
     
   XmlRpc::XmlRpcValue analyzer_params;
@@ -80,6 +203,16 @@ bool AnalyzerGroup::init(const string base_path, const ros::NodeHandle &n)
     XmlRpc::XmlRpcValue analyzer_value = xml_it->second;
 
     string ns = analyzer_name;
+    string config = analyzer_value.toXml();
+
+    int reuse = previous ? previous->findConfig(ns, config) : -1;
+    if (reuse >= 0)
+    {
+      appendAnalyzer(previous->analyzers_[reuse], previous->configs_[reuse]);
+      ++reused;
+      continue;
+    }
+    ++loaded;
     
     if (!analyzer_value.hasMember("type"))
     {
@@ -96,31 +229,16 @@ bool AnalyzerGroup::init(const string base_path, const ros::NodeHandle &n)
     boost::shared_ptr<Analyzer> analyzer;
     try
     {
-      // Look for non-fully qualified class name for Analyzer type
-      if (!analyzer_loader_.isClassAvailable(an_type))
+      string class_name = resolveAnalyzerType(an_type);
+      if (class_name.empty())
       {
-        bool have_class = false;
-        vector<string> classes = analyzer_loader_.getDeclaredClasses();
-        for(unsigned int i = 0; i < classes.size(); ++i)
-        {
-          if(an_type == analyzer_loader_.getName(classes[i]))
-          {
-            //if we've found a match... we'll get the fully qualified name and break out of the loop
-            ROS_WARN("Analyzer specification should now include the package name. You are using a deprecated API. Please switch from %s to %s in your Analyzer specification.",
-                     an_type.c_str(), classes[i].c_str());
-            an_type = classes[i];
-            have_class = true;
-            break;
-          }
-        }
-        if (!have_class)
-        {
-          ROS_ERROR("Unable to find Analyzer class %s. Check that Analyzer is fully declared.", an_type.c_str());
-          continue;
-        }
+        ROS_ERROR("Unable to find Analyzer class %s. Check that Analyzer is fully declared.", an_type.c_str());
+        init_ok = false;
+        continue;
       }
+      an_type = class_name;
 
-      analyzer = analyzer_loader_.createInstance(an_type);
+      analyzer = analyzer_loader_->createInstance(an_type);
     }
     catch (pluginlib::LibraryLoadException& e)
     {
@@ -149,7 +267,19 @@ bool AnalyzerGroup::init(const string base_path, const ros::NodeHandle &n)
       continue;
     }
     
-    analyzers_.push_back(analyzer);
+    appendAnalyzer(analyzer, make_pair(ns, config));
+  }
+
+  // Analyzers added with addAnalyzer() have no parameters here, keep them
+  if (previous)
+  {
+    for (unsigned int j = 0; j < previous->analyzers_.size(); ++j)
+    {
+      if (previous->configs_[j].first.empty())
+      {
+        appendAnalyzer(previous->analyzers_[j], previous->configs_[j]);
+      }
+    }
   }
 
   if (analyzers_.size() == 0)
@@ -161,14 +291,60 @@ bool AnalyzerGroup::init(const string base_path, const ros::NodeHandle &n)
   return init_ok;
 }
 
+string AnalyzerGroup::resolveAnalyzerType(const string &an_type)
+{
+  if (analyzer_loader_->isClassAvailable(an_type))
+    return an_type;
+
+  // Look for non-fully qualified class name for Analyzer type
+  if (short_class_names_.empty())
+  {
+    vector<string> classes = analyzer_loader_->getDeclaredClasses();
+    for (unsigned int i = 0; i < classes.size(); ++i)
+    {
+      // First declared class wins, like the search this replaces
+      string short_name = analyzer_loader_->getName(classes[i]);
+      if (!short_class_names_.count(short_name))
+        short_class_names_[short_name] = classes[i];
+    }
+  }
+
+  map<string, string>::const_iterator it = short_class_names_.find(an_type);
+  if (it == short_class_names_.end())
+    return "";
+
+  ROS_WARN("Analyzer specification should now include the package name. You are using a deprecated API. Please switch from %s to %s in your Analyzer specification.",
+           an_type.c_str(), it->second.c_str());
+  return it->second;
+}
+
 AnalyzerGroup::~AnalyzerGroup()
 {
   analyzers_.clear();
 }
 
-bool AnalyzerGroup::addAnalyzer(boost::shared_ptr<Analyzer>& analyzer)
+int AnalyzerGroup::findConfig(const string &ns, const string &config) const
+{
+  for (unsigned int j = 0; j < configs_.size(); ++j)
+  {
+    if (configs_[j].first == ns && configs_[j].second == config)
+      return j;
+  }
+  return -1;
+}
+
+void AnalyzerGroup::appendAnalyzer(const boost::shared_ptr<Analyzer> &analyzer,
+                                   const pair<string, string> &config)
 {
   analyzers_.push_back(analyzer);
+  timings_.push_back(AnalyzerTiming());
+  configs_.push_back(config);
+  analyzer_names_.push_back(make_pair(analyzer->getPath(), analyzer->getName()));
+}
+
+bool AnalyzerGroup::addAnalyzer(boost::shared_ptr<Analyzer>& analyzer)
+{
+  appendAnalyzer(analyzer, make_pair(string(), string()));
   return true;
 }
 
@@ -177,61 +353,363 @@ bool AnalyzerGroup::removeAnalyzer(boost::shared_ptr<Analyzer>& analyzer)
   vector<boost::shared_ptr<Analyzer> >::iterator it = find(analyzers_.begin(), analyzers_.end(), analyzer);
   if (it != analyzers_.end())
   {
+    timings_.erase(timings_.begin() + (it - analyzers_.begin()));
+    configs_.erase(configs_.begin() + (it - analyzers_.begin()));
+    analyzer_names_.erase(analyzer_names_.begin() + (it - analyzers_.begin()));
     analyzers_.erase(it);
     return true;
   }
   return false;
 }
 
-bool AnalyzerGroup::match(const string name)
+bool AnalyzerGroup::matchRef(const string &name)
 {
   if (analyzers_.size() == 0)
     return false;
 
-  bool match_name = false;
-  if (matched_.count(name))
+  vector<bool> *cached = findMatches(name);
+  if (cached)
   {
-    vector<bool> &mtch_vec = matched_[name];
-    for (unsigned int i = 0; i < mtch_vec.size(); ++i)
+    ++match_hits_;
+    for (unsigned int i = 0; i < cached->size(); ++i)
     {
-      if (mtch_vec[i])
+      if ((*cached)[i])
         return true;
     }
     return false;
   }
-  
-  matched_[name].resize(analyzers_.size());
+
+  ++match_misses_;
+  checkCardinality(name);
+
+  bool match_name = false;
+  vector<bool> mtch_vec(analyzers_.size());
   for (unsigned int i = 0; i < analyzers_.size(); ++i)
   {
-    bool mtch = analyzers_[i]->match(name);
+    bool mtch;
+    if (profile_)
+    {
+      SteadyClock::time_point start = SteadyClock::now();
+      mtch = analyzers_[i]->matchRef(name);
+      timings_[i].match_time += SteadyClock::now() - start;
+      ++timings_[i].match_calls;
+    }
+    else
+      mtch = analyzers_[i]->matchRef(name);
+
     match_name = mtch || match_name;
-    matched_[name].at(i) = mtch;
+    mtch_vec[i] = mtch;
   }
 
+  insertMatches(name, mtch_vec);
+
   return match_name;
 }
 
+/*!
+ *\brief Approximate memory used by one match cache entry
+ */
+static size_t matchEntryBytes(const string &name, size_t num_matches)
+{
+  // Name is stored in the map and the list, plus node and vector overhead
+  return 2 * name.size() + num_matches / 8 + 128;
+}
+
+vector<bool> *AnalyzerGroup::findMatches(const string &name)
+{
+  map<string, MatchList::iterator>::iterator it = matched_.find(name);
+  if (it == matched_.end())
+    return NULL;
+
+  // Move to front, most recently used
+  match_lru_.splice(match_lru_.begin(), match_lru_, it->second);
+  return &it->second->matches;
+}
+
+void AnalyzerGroup::insertMatches(const string &name, const vector<bool> &matches)
+{
+  map<string, MatchList::iterator>::iterator it = matched_.find(name);
+  if (it != matched_.end())
+  {
+    match_cache_bytes_ -= matchEntryBytes(name, it->second->matches.size());
+    match_lru_.erase(it->second);
+    matched_.erase(it);
+  }
+
+  MatchEntry entry;
+  entry.name = name;
+  entry.matches = matches;
+  match_lru_.push_front(entry);
+  matched_[name] = match_lru_.begin();
+  match_cache_bytes_ += matchEntryBytes(name, matches.size());
+
+  // Never evict the entry just added, analyze() needs it next
+  while (max_match_cache_bytes_ > 0 && match_cache_bytes_ > max_match_cache_bytes_ && match_lru_.size() > 1)
+  {
+    const MatchEntry &oldest = match_lru_.back();
+    match_cache_bytes_ -= matchEntryBytes(oldest.name, oldest.matches.size());
+    matched_.erase(oldest.name);
+    match_lru_.pop_back();
+    ++match_evictions_;
+  }
+}
+
+void AnalyzerGroup::checkCardinality(const string &name)
+{
+  if (prefix_warn_count_ <= 0)
+    return;
+
+  string prefix = name.substr(0, name.find_first_of("0123456789"));
+  if (warned_prefixes_.count(prefix))
+    return;
+
+  // Don't let the counters grow without bound either
+  if (prefix_names_.size() > 10000 || prefix_names_count_ > 100000)
+  {
+    prefix_names_.clear();
+    prefix_names_count_ = 0;
+  }
+
+  // A name evicted from the cache misses again, but isn't a new name
+  set<size_t> &names = prefix_names_[prefix];
+  if (!names.insert(boost::hash<string>()(name)).second)
+    return;
+  ++prefix_names_count_;
+
+  if ((int)names.size() > prefix_warn_count_)
+  {
+    ROS_WARN("More than %d different status names start with \"%s\" in AnalyzerGroup %s. Status names should not contain IDs or times.",
+             prefix_warn_count_, prefix.c_str(), path_.c_str());
+    warned_prefixes_.insert(prefix);
+    prefix_names_count_ -= names.size();
+    prefix_names_.erase(prefix);
+  }
+}
+
 void AnalyzerGroup::resetMatches()
 {
   matched_.clear();
+  match_lru_.clear();
+  match_cache_bytes_ = 0;
 }
 
+boost::shared_ptr<AnalyzerGroup> AnalyzerGroup::clone() const
+{
+  boost::shared_ptr<AnalyzerGroup> group(new AnalyzerGroup());
+  group->path_ = path_;
+  group->nice_name_ = nice_name_;
+  group->aux_items_ = aux_items_;
+  group->analyzers_ = analyzers_;
+  group->timings_.resize(analyzers_.size());
+  group->configs_ = configs_;
+  group->analyzer_names_ = analyzer_names_;
+  group->profile_ = profile_;
+  group->report_pool_ = report_pool_;
+  group->max_match_cache_bytes_ = max_match_cache_bytes_;
+  group->prefix_warn_count_ = prefix_warn_count_;
+  return group;
+}
 
-bool AnalyzerGroup::analyze(const boost::shared_ptr<StatusItem> item)
+boost::shared_ptr<AnalyzerGroup> AnalyzerGroup::reload(const ros::NodeHandle &n, unsigned int &loaded,
+                                                       unsigned int &reused) const
 {
-  ROS_ASSERT_MSG(matched_.count(item->getName()), "AnalyzerGroup was asked to analyze an item it hadn't matched.");
+  boost::shared_ptr<AnalyzerGroup> group(new AnalyzerGroup());
+  group->path_ = path_;
+  group->nice_name_ = nice_name_;
+  group->profile_ = profile_;
+  group->report_pool_ = report_pool_;
+  group->max_match_cache_bytes_ = max_match_cache_bytes_;
+  group->prefix_warn_count_ = prefix_warn_count_;
+
+  loaded = 0;
+  reused = 0;
+  if (!group->loadAnalyzers(n, this, loaded, reused))
+  {
+    ROS_ERROR("Reloading AnalyzerGroup %s had errors, keeping its analyzers.", path_.c_str());
+    return boost::shared_ptr<AnalyzerGroup>();
+  }
+
+  return group;
+}
+
+void AnalyzerGroup::takeOver(const AnalyzerGroup &previous, const vector<boost::shared_ptr<StatusItem> > &items,
+                             vector<bool> &matched)
+{
+  vector<int> columns(analyzers_.size(), -1);
+  for (unsigned int i = 0; i < analyzers_.size(); ++i)
+  {
+    vector<boost::shared_ptr<Analyzer> >::const_iterator it =
+      find(previous.analyzers_.begin(), previous.analyzers_.end(), analyzers_[i]);
+    if (it != previous.analyzers_.end())
+      columns[i] = it - previous.analyzers_.begin();
+  }
+
+  // Least recently used first, so the order of the cache is kept
+  MatchList::const_reverse_iterator entry;
+  for (entry = previous.match_lru_.rbegin(); entry != previous.match_lru_.rend(); ++entry)
+  {
+    vector<bool> matches(analyzers_.size());
+    for (unsigned int i = 0; i < analyzers_.size(); ++i)
+      matches[i] = columns[i] >= 0 ? entry->matches[columns[i]] : analyzers_[i]->matchRef(entry->name);
+
+    insertMatches(entry->name, matches);
+  }
+
+  // Shared analyzers already have their items
+  matched.assign(items.size(), false);
+  for (unsigned int k = 0; k < items.size(); ++k)
+  {
+    if (!matchRef(items[k]->getName()))
+      continue;
+
+    matched[k] = true;
+    const vector<bool> &matches = *findMatches(items[k]->getName());
+    for (unsigned int i = 0; i < analyzers_.size(); ++i)
+    {
+      if (matches[i] && columns[i] < 0)
+        analyzers_[i]->analyzeRef(items[k]);
+    }
+  }
+}
+
+vector<bool> AnalyzerGroup::getMatches(const string &name) const
+{
+  map<string, MatchList::iterator>::const_iterator it = matched_.find(name);
+  if (it == matched_.end())
+    return vector<bool>();
+
+  return it->second->matches;
+}
+
+bool AnalyzerGroup::setMatches(const string &name, const vector<bool> &matches)
+{
+  if (matches.size() != analyzers_.size())
+    return false;
+
+  insertMatches(name, matches);
+  return true;
+}
+
+
+bool AnalyzerGroup::analyzeRef(const boost::shared_ptr<StatusItem> &item)
+{
+  vector<bool> *cached = findMatches(item->getName());
+  ROS_ASSERT_MSG(cached, "AnalyzerGroup was asked to analyze an item it hadn't matched.");
+  if (!cached)
+    return false;
 
   bool analyzed = false;
-  vector<bool> &mtch_vec = matched_[item->getName()];
+  const vector<bool> &mtch_vec = *cached;
   for (unsigned int i = 0; i < mtch_vec.size(); ++i)
   {
-    if (mtch_vec[i])
-      analyzed = analyzers_[i]->analyze(item) || analyzed;
+    if (!mtch_vec[i])
+      continue;
+
+    if (profile_)
+    {
+      SteadyClock::time_point start = SteadyClock::now();
+      analyzed = analyzers_[i]->analyzeRef(item) || analyzed;
+      timings_[i].analyze_time += SteadyClock::now() - start;
+      ++timings_[i].analyze_calls;
+    }
+    else
+      analyzed = analyzers_[i]->analyzeRef(item) || analyzed;
   }
   
   return analyzed;
 }
 
+void AnalyzerGroup::analyzeBatch(const boost::shared_ptr<StatusItem> *items, size_t count,
+                                 vector<bool> &analyzed)
+{
+  for (size_t i = 0; i < count; ++i)
+    analyzed[i] = false;
+
+  // Indices of the items matched by each analyzer. The match vectors are read
+  // right after match(), so they can't have been evicted from the cache.
+  vector<vector<unsigned int> > matched(analyzers_.size());
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (!matchRef(items[i]->getName()))
+      continue;
+
+    const vector<bool> &mtch_vec = *findMatches(items[i]->getName());
+    for (unsigned int j = 0; j < mtch_vec.size(); ++j)
+    {
+      if (mtch_vec[j])
+        matched[j].push_back(i);
+    }
+  }
+
+  vector<boost::shared_ptr<StatusItem> > batch;
+  vector<bool> batch_analyzed;
+  for (unsigned int j = 0; j < analyzers_.size(); ++j)
+  {
+    if (matched[j].empty())
+      continue;
+
+    batch.clear();
+    for (unsigned int k = 0; k < matched[j].size(); ++k)
+      batch.push_back(items[matched[j][k]]);
+    batch_analyzed.assign(batch.size(), false);
+
+    if (profile_)
+    {
+      SteadyClock::time_point start = SteadyClock::now();
+      analyzers_[j]->analyzeBatch(&batch[0], batch.size(), batch_analyzed);
+      timings_[j].analyze_time += SteadyClock::now() - start;
+      timings_[j].analyze_calls += batch.size();
+    }
+    else
+      analyzers_[j]->analyzeBatch(&batch[0], batch.size(), batch_analyzed);
+
+    for (unsigned int k = 0; k < matched[j].size(); ++k)
+    {
+      if (batch_analyzed[k])
+        analyzed[matched[j][k]] = true;
+    }
+  }
+}
+
+void AnalyzerGroup::reportAnalyzer(unsigned int j, vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > *output,
+                                   ReportLatch *latch)
+{
+  try
+  {
+    if (profile_)
+    {
+      SteadyClock::time_point start = SteadyClock::now();
+      *output = analyzers_[j]->report();
+      timings_[j].report_time += SteadyClock::now() - start;
+      ++timings_[j].report_calls;
+    }
+    else
+      *output = analyzers_[j]->report();
+  }
+  catch (std::exception &e)
+  {
+    if (!latch)
+      throw;
+    latch->fail("Analyzer " + analyzer_names_[j].first + " threw an exception in report(): " + e.what());
+  }
+  catch (...)
+  {
+    if (!latch)
+      throw;
+    latch->fail("Analyzer " + analyzer_names_[j].first + " threw an unknown exception in report()");
+  }
+
+  // The report() thread of the group must not be left waiting
+  if (latch)
+    latch->countDown();
+}
+
+void AnalyzerGroup::getExpectedItems(map<string, int> &expected) const
+{
+  for (unsigned int i = 0; i < analyzers_.size(); ++i)
+    analyzers_[i]->getExpectedItems(expected);
+}
+
 vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > AnalyzerGroup::report()
 {
   vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > output;
@@ -253,14 +731,31 @@ vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > AnalyzerGroup::rep
     return output;
   }
 
+  vector<vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > > reports(analyzers_.size());
+  if (report_pool_ && analyzers_.size() > 1)
+  {
+    ReportLatch latch(analyzers_.size());
+    for (unsigned int j = 0; j < analyzers_.size(); ++j)
+      report_pool_->service.post(boost::bind(&AnalyzerGroup::reportAnalyzer, this, j, &reports[j], &latch));
+    latch.wait();
+
+    if (latch.failed)
+      throw std::runtime_error(latch.error);
+  }
+  else
+  {
+    for (unsigned int j = 0; j < analyzers_.size(); ++j)
+      reportAnalyzer(j, &reports[j], NULL);
+  }
+
   bool all_stale = true;
 
   for (unsigned int j = 0; j < analyzers_.size(); ++j)
   {
-    string path = analyzers_[j]->getPath();
-    string nice_name = analyzers_[j]->getName();
+    const string &path = analyzer_names_[j].first;
+    const string &nice_name = analyzer_names_[j].second;
 
-    vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > processed = analyzers_[j]->report();
+    const vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > &processed = reports[j];
 
     // Do not report anything in the header values for analyzers that don't report
     if (processed.size() == 0)
@@ -304,3 +799,84 @@ vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > AnalyzerGroup::rep
 
   return output;
 }
+
+/*!
+ *\brief Adds call count, total and mean time of one analyzer function to status
+ */
+static void addTimingValues(diagnostic_msgs::DiagnosticStatus &status, const string &func,
+                            unsigned long calls, SteadyClock::duration time)
+{
+  double total_sec = boost::chrono::duration<double>(time).count();
+
+  stringstream calls_str, total_str, mean_str;
+  calls_str << calls;
+  total_str << total_sec;
+  mean_str << (calls > 0 ? total_sec * 1e6 / calls : 0.0);
+
+  diagnostic_msgs::KeyValue kv;
+  kv.key = func + " calls";
+  kv.value = calls_str.str();
+  status.values.push_back(kv);
+  kv.key = func + " time (s)";
+  kv.value = total_str.str();
+  status.values.push_back(kv);
+  kv.key = func + " mean (us)";
+  kv.value = mean_str.str();
+  status.values.push_back(kv);
+}
+
+/*!
+ *\brief Adds a count to status values
+ */
+static void addCountValue(diagnostic_msgs::DiagnosticStatus &status, const string &key, unsigned long count)
+{
+  stringstream count_str;
+  count_str << count;
+
+  diagnostic_msgs::KeyValue kv;
+  kv.key = key;
+  kv.value = count_str.str();
+  status.values.push_back(kv);
+}
+
+vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > AnalyzerGroup::reportStats() const
+{
+  vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > output;
+
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> cache_status(new diagnostic_msgs::DiagnosticStatus);
+  cache_status->name = path_;
+  cache_status->level = 0;
+  cache_status->message = "Match cache";
+  addCountValue(*cache_status, "cache entries", match_lru_.size());
+  addCountValue(*cache_status, "cache bytes", match_cache_bytes_);
+  addCountValue(*cache_status, "cache max bytes", max_match_cache_bytes_);
+  addCountValue(*cache_status, "cache hits", match_hits_);
+  addCountValue(*cache_status, "cache misses", match_misses_);
+  addCountValue(*cache_status, "cache evictions", match_evictions_);
+  if (!warned_prefixes_.empty())
+  {
+    cache_status->level = 1;
+    cache_status->message = "Too many status names with the same prefix";
+  }
+  output.push_back(cache_status);
+
+  if (!profile_)
+    return output;
+
+  for (unsigned int i = 0; i < analyzers_.size(); ++i)
+  {
+    boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> status(new diagnostic_msgs::DiagnosticStatus);
+    status->name = analyzer_names_[i].first;
+    status->level = 0;
+    status->message = "OK";
+
+    const AnalyzerTiming &timing = timings_[i];
+    addTimingValues(*status, "match", timing.match_calls, timing.match_time);
+    addTimingValues(*status, "analyze", timing.analyze_calls, timing.analyze_time);
+    addTimingValues(*status, "report", timing.report_calls, timing.report_time);
+
+    output.push_back(status);
+  }
+
+  return output;
+}
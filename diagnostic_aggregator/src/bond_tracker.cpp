@@ -0,0 +1,196 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <diagnostic_aggregator/bond_tracker.h>
+#include <algorithm>
+#include <boost/functional/hash.hpp>
+#include <boost/uuid/uuid_generators.hpp>
+#include <boost/uuid/uuid_io.hpp>
+
+using namespace diagnostic_aggregator;
+using namespace std;
+
+// Ticks per heartbeat period
+static const unsigned int NUM_SLOTS = 20;
+
+BondTracker::BondTracker(ros::NodeHandle &n, const string &topic, const string &heartbeat_topic,
+                         double heartbeat_period, double heartbeat_timeout, double connect_timeout) :
+  instance_id_(boost::uuids::to_string(boost::uuids::random_generator()())),
+  heartbeat_period_(heartbeat_period),
+  heartbeat_timeout_(heartbeat_timeout),
+  connect_timeout_(connect_timeout),
+  wheel_(NUM_SLOTS),
+  next_slot_(0)
+{
+  // All clients share the queue, so it must hold a heartbeat of each
+  sub_ = n.subscribe(topic, 1000, &BondTracker::statusCallback, this);
+  pub_ = n.advertise<bond::Status>(heartbeat_topic, 100);
+  timer_ = n.createTimer(ros::Duration(heartbeat_period_ / NUM_SLOTS), &BondTracker::tick, this);
+}
+
+BondTracker::~BondTracker()
+{
+  timer_.stop();
+  sub_.shutdown();
+
+  // Let the clients know right away, instead of at their timeout
+  publishStatus("", false);
+}
+
+bool BondTracker::add(const string &id, const boost::function<void(void)> &on_formed,
+                      const boost::function<void(void)> &on_broken)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (clients_.count(id))
+    return false;
+
+  Client &client = clients_[id];
+  client.on_formed = on_formed;
+  client.on_broken = on_broken;
+  client.last_heard = ros::Time::now();
+  client.slot = boost::hash<string>()(id) % NUM_SLOTS;
+  wheel_[client.slot].push_back(id);
+  return true;
+}
+
+bool BondTracker::contains(const string &id) const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return clients_.count(id) > 0;
+}
+
+unsigned int BondTracker::size() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return clients_.size();
+}
+
+void BondTracker::remove(const string &id)
+{
+  map<string, Client>::iterator it = clients_.find(id);
+  if (it == clients_.end())
+    return;
+
+  vector<string> &slot = wheel_[it->second.slot];
+  vector<string>::iterator pos = find(slot.begin(), slot.end(), id);
+  if (pos != slot.end())
+  {
+    *pos = slot.back();
+    slot.pop_back();
+  }
+
+  clients_.erase(it);
+}
+
+void BondTracker::publishStatus(const string &id, bool active)
+{
+  bond::Status status;
+  status.header.stamp = ros::Time::now();
+  status.id = id;
+  status.instance_id = instance_id_;
+  status.active = active;
+  status.heartbeat_timeout = heartbeat_timeout_;
+  status.heartbeat_period = heartbeat_period_;
+  pub_.publish(status);
+}
+
+void BondTracker::statusCallback(const bond::Status::ConstPtr &msg)
+{
+  boost::function<void(void)> callback;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    map<string, Client>::iterator it = clients_.find(msg->id);
+    if (it == clients_.end())
+      return;
+
+    Client &client = it->second;
+    if (!client.sister_instance_id.empty() && client.sister_instance_id != msg->instance_id)
+      return;
+
+    if (msg->active)
+    {
+      client.last_heard = ros::Time::now();
+      if (!client.formed)
+      {
+        client.formed = true;
+        client.sister_instance_id = msg->instance_id;
+        callback = client.on_formed;
+      }
+    }
+    else
+    {
+      ROS_DEBUG("Bond %s was broken by the other side.", msg->id.c_str());
+      callback = client.on_broken;
+      remove(msg->id);
+    }
+  }
+
+  if (callback)
+    callback();
+}
+
+void BondTracker::tick(const ros::TimerEvent &event)
+{
+  vector<boost::function<void(void)> > broken;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    ros::Time now = ros::Time::now();
+
+    if (next_slot_ == 0)
+      publishStatus("", true);
+
+    // Copied, bonds that time out are removed from the slot
+    vector<string> slot = wheel_[next_slot_];
+    next_slot_ = (next_slot_ + 1) % NUM_SLOTS;
+
+    for (unsigned int i = 0; i < slot.size(); ++i)
+    {
+      Client &client = clients_[slot[i]];
+      double timeout = client.formed ? heartbeat_timeout_ : connect_timeout_;
+      if ((now - client.last_heard).toSec() > timeout)
+      {
+        ROS_DEBUG("Bond %s timed out.", slot[i].c_str());
+        publishStatus(slot[i], false);
+        broken.push_back(client.on_broken);
+        remove(slot[i]);
+      }
+    }
+  }
+
+  for (unsigned int i = 0; i < broken.size(); ++i)
+  {
+    if (broken[i])
+      broken[i]();
+  }
+}
@@ -35,10 +35,35 @@
 /**< \author Kevin Watts */
 
 #include "diagnostic_aggregator/generic_analyzer.h"
+#include <boost/thread/mutex.hpp>
 
 using namespace diagnostic_aggregator;
 using namespace std;
 
+namespace {
+
+boost::mutex regex_mutex;
+map<string, boost::regex> compiled_regexes;
+
+/*
+ * Compiles each expression once per process. Copies of a boost::regex share
+ * the compiled expression, so analyzers loaded several times (shards, added
+ * diagnostics) don't compile them again. Throws boost::regex_error.
+ */
+boost::regex compileRegex(const string &expression)
+{
+  boost::mutex::scoped_lock lock(regex_mutex);
+  map<string, boost::regex>::iterator it = compiled_regexes.find(expression);
+  if (it != compiled_regexes.end())
+    return it->second;
+
+  boost::regex re(expression);
+  compiled_regexes[expression] = re;
+  return re;
+}
+
+}
+
 PLUGINLIB_EXPORT_CLASS(diagnostic_aggregator::GenericAnalyzer, 
                        diagnostic_aggregator::Analyzer)
 
@@ -101,8 +126,7 @@ bool GenericAnalyzer::init(const string base_path, const ros::NodeHandle &n)
     {
       try
       {
-        boost::regex re(regex_strs[i]);
-        regex_.push_back(re);
+        regex_.push_back(compileRegex(regex_strs[i]));
       }
       catch (boost::regex_error& e)
       {
@@ -130,6 +154,8 @@ bool GenericAnalyzer::init(const string base_path, const ros::NodeHandle &n)
   n.param("timeout", timeout, 5.0);   // Timeout for stale
   n.param("num_items", num_items_expected, -1); // Number of items must match this
   n.param("discard_stale", discard_stale, false);
+  double rate_degraded_factor;
+  n.param("rate_degraded_factor", rate_degraded_factor, 0.0);
 
   string my_path;
   if (base_path == "/")
@@ -141,7 +167,7 @@ bool GenericAnalyzer::init(const string base_path, const ros::NodeHandle &n)
     my_path = "/" + my_path;
 
   return GenericAnalyzerBase::init(my_path, nice_name, 
-                                   timeout, num_items_expected, discard_stale);
+                                   timeout, num_items_expected, discard_stale, rate_degraded_factor);
 }
 
 GenericAnalyzer::~GenericAnalyzer() { }
@@ -0,0 +1,145 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include "diagnostic_aggregator/item_history.h"
+#include <boost/functional/hash.hpp>
+
+using namespace diagnostic_aggregator;
+using namespace std;
+
+size_t HistoryMessages::add(const string &message)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  // Probe past other messages with the same hash
+  size_t key = boost::hash<string>()(message);
+  map<size_t, Entry>::iterator it = entries_.find(key);
+  while (it != entries_.end() && it->second.message != message)
+    it = entries_.find(++key);
+
+  if (it != entries_.end())
+  {
+    ++it->second.refs;
+    return key;
+  }
+
+  Entry &entry = entries_[key];
+  entry.message = message;
+  entry.refs = 1;
+  return key;
+}
+
+void HistoryMessages::release(size_t key)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  map<size_t, Entry>::iterator it = entries_.find(key);
+  if (it == entries_.end())
+    return;
+
+  if (--it->second.refs == 0)
+    entries_.erase(it);
+}
+
+const string &HistoryMessages::get(size_t key) const
+{
+  static const string empty;
+
+  boost::mutex::scoped_lock lock(mutex_);
+  map<size_t, Entry>::const_iterator it = entries_.find(key);
+  if (it == entries_.end())
+    return empty;
+
+  return it->second.message;
+}
+
+size_t HistoryMessages::size() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return entries_.size();
+}
+
+ItemHistory::ItemHistory(unsigned int capacity, const boost::shared_ptr<HistoryMessages> &messages) :
+  messages_(messages),
+  capacity_(capacity),
+  next_(0),
+  count_(0)
+{
+  ROS_ASSERT_MSG(capacity_ > 0, "ItemHistory capacity must be greater than 0");
+
+  stamps_.resize(capacity_);
+  levels_.resize(capacity_);
+  keys_.resize(capacity_);
+}
+
+ItemHistory::~ItemHistory()
+{
+  for (unsigned int i = 0; i < count_; ++i)
+    messages_->release(keys_[i]);
+}
+
+void ItemHistory::add(const ros::Time &stamp, int8_t level, const string &message)
+{
+  if (count_ > 0)
+  {
+    unsigned int last = (next_ + capacity_ - 1) % capacity_;
+    if (levels_[last] == level && messages_->get(keys_[last]) == message)
+      return;
+  }
+
+  // Add first, so a message that's already in the ring isn't removed from the table
+  size_t key = messages_->add(message);
+
+  if (count_ == capacity_)
+    messages_->release(keys_[next_]);
+  else
+    ++count_;
+
+  stamps_[next_] = stamp;
+  levels_[next_] = level;
+  keys_[next_] = key;
+  next_ = (next_ + 1) % capacity_;
+}
+
+void ItemHistory::get(vector<ros::Time> &stamps, vector<int8_t> &levels,
+                        vector<string> &messages) const
+{
+  unsigned int first = (next_ + capacity_ - count_) % capacity_;
+  for (unsigned int i = 0; i < count_; ++i)
+  {
+    unsigned int j = (first + i) % capacity_;
+    stamps.push_back(stamps_[j]);
+    levels.push_back(levels_[j]);
+    messages.push_back(messages_->get(keys_[j]));
+  }
+}
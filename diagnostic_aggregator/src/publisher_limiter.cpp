@@ -0,0 +1,145 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <diagnostic_aggregator/publisher_limiter.h>
+#include <algorithm>
+#include <sstream>
+
+using namespace diagnostic_aggregator;
+using namespace std;
+
+PublisherLimiter::PublisherLimiter(double rate, double burst, double idle_timeout) :
+  rate_(rate),
+  burst_(max(burst, 1.0)),
+  idle_timeout_(idle_timeout),
+  reported_dropped_(0)
+{
+  // A bucket forgotten before it's full would come back with extra tokens
+  if (rate_ > 0)
+    idle_timeout_ = max(idle_timeout_, burst_ / rate_);
+}
+
+bool PublisherLimiter::allow(const string &publisher, unsigned int statuses)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  map<string, Bucket>::iterator it = buckets_.find(publisher);
+  if (it == buckets_.end())
+  {
+    it = buckets_.insert(make_pair(publisher, Bucket())).first;
+    it->second.tokens = burst_;
+    it->second.last_fill = ros::WallTime::now();
+  }
+  Bucket &bucket = it->second;
+
+  ros::WallTime now = ros::WallTime::now();
+  if (rate_ > 0)
+    bucket.tokens = min(burst_, bucket.tokens + rate_ * (now - bucket.last_fill).toSec());
+  bucket.last_fill = now;
+
+  if (rate_ > 0)
+  {
+    if (bucket.tokens < 1.0)
+    {
+      bucket.dropped += statuses;
+      return false;
+    }
+    bucket.tokens -= 1.0;
+  }
+
+  bucket.accepted += statuses;
+  return true;
+}
+
+void PublisherLimiter::countDropped(const string &publisher, unsigned int statuses)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  map<string, Bucket>::iterator it = buckets_.find(publisher);
+  if (it == buckets_.end())
+    return;
+
+  // Accepted by allow() first
+  Bucket &bucket = it->second;
+  bucket.accepted -= min<uint64_t>(bucket.accepted, statuses);
+  bucket.dropped += statuses;
+}
+
+boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> PublisherLimiter::report(const string &name)
+{
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> status(new diagnostic_msgs::DiagnosticStatus());
+  status->name = name;
+
+  boost::mutex::scoped_lock lock(mutex_);
+  ros::WallTime now = ros::WallTime::now();
+  uint64_t total_dropped = 0, forgotten_dropped = 0;
+  map<string, Bucket>::iterator it = buckets_.begin();
+  while (it != buckets_.end())
+  {
+    if ((now - it->second.last_fill).toSec() > idle_timeout_)
+    {
+      forgotten_dropped += it->second.dropped;
+      buckets_.erase(it++);
+      continue;
+    }
+
+    total_dropped += it->second.dropped;
+    if (it->second.dropped == 0)
+    {
+      ++it;
+      continue;
+    }
+
+    stringstream value;
+    value << "dropped " << it->second.dropped << " of " << it->second.accepted + it->second.dropped << " statuses";
+    diagnostic_msgs::KeyValue kv;
+    kv.key = it->first;
+    kv.value = value.str();
+    status->values.push_back(kv);
+    ++it;
+  }
+
+  // Drops of forgotten publishers were counted at the last report, or just now
+  if (total_dropped + forgotten_dropped > reported_dropped_)
+  {
+    status->level = diagnostic_msgs::DiagnosticStatus::WARN;
+    status->message = "Dropping messages";
+  }
+  else
+  {
+    status->level = diagnostic_msgs::DiagnosticStatus::OK;
+    status->message = "OK";
+  }
+  reported_dropped_ = total_dropped;
+
+  return status;
+}
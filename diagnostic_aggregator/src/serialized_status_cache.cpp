@@ -0,0 +1,125 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include "diagnostic_aggregator/serialized_status_cache.h"
+
+using namespace diagnostic_aggregator;
+using namespace std;
+
+bool diagnostic_aggregator::sameStatus(const diagnostic_msgs::DiagnosticStatus &a,
+                                       const diagnostic_msgs::DiagnosticStatus &b)
+{
+  if (a.level != b.level || a.name != b.name || a.message != b.message ||
+      a.hardware_id != b.hardware_id || a.values.size() != b.values.size())
+    return false;
+
+  for (unsigned int i = 0; i < a.values.size(); ++i)
+  {
+    if (a.values[i].key != b.values[i].key || a.values[i].value != b.values[i].value)
+      return false;
+  }
+
+  return true;
+}
+
+SerializedStatusCache::SerializedStatusCache() :
+  generation_(0),
+  encoded_(0),
+  reused_(0)
+{ }
+
+void SerializedStatusCache::encode(const diagnostic_msgs::DiagnosticStatus &status, vector<uint8_t> &bytes)
+{
+  bytes.resize(ros::serialization::serializationLength(status));
+  if (bytes.empty())
+    return;
+
+  ros::serialization::OStream stream(&bytes[0], bytes.size());
+  ros::serialization::serialize(stream, status);
+}
+
+void SerializedStatusCache::build(const std_msgs::Header &header,
+                                  const vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > &statuses,
+                                  CachedDiagnosticArray &out)
+{
+  // Never 0, which marks new entries
+  if (++generation_ == 0)
+    ++generation_;
+
+  duplicates_.clear();
+  out.header = header;
+  out.statuses.clear();
+  out.statuses.reserve(statuses.size());
+
+  for (unsigned int i = 0; i < statuses.size(); ++i)
+  {
+    const diagnostic_msgs::DiagnosticStatus &status = *statuses[i];
+    Entry &entry = entries_[status.name];
+
+    // Two statuses with the same name, the entry already holds the first one
+    if (entry.generation == generation_)
+    {
+      duplicates_.push_back(vector<uint8_t>());
+      encode(status, duplicates_.back());
+      out.statuses.push_back(&duplicates_.back());
+      ++encoded_;
+      continue;
+    }
+
+    const StatusMsgSource *source = boost::get_deleter<StatusMsgSource>(statuses[i]);
+    if (entry.generation == 0 || !source || source->version != entry.version || source->stale != entry.stale ||
+        source->override_hash != entry.override_hash)
+    {
+      encode(status, entry.bytes);
+      entry.version = source ? source->version : 0;
+      entry.stale = source && source->stale;
+      entry.override_hash = source ? source->override_hash : 0;
+      ++encoded_;
+    }
+    else
+      ++reused_;
+
+    entry.generation = generation_;
+    out.statuses.push_back(&entry.bytes);
+  }
+
+  map<string, Entry>::iterator it = entries_.begin();
+  while (it != entries_.end())
+  {
+    if (it->second.generation != generation_)
+      entries_.erase(it++);
+    else
+      ++it;
+  }
+}
@@ -0,0 +1,253 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include "diagnostic_aggregator/snapshot.h"
+#include <ros/serialization.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace diagnostic_aggregator;
+using namespace std;
+
+namespace {
+
+const char SNAPSHOT_MAGIC[4] = { 'D', 'A', 'G', 'S' };
+const uint32_t SNAPSHOT_VERSION = 1;
+
+/*
+ * File layout, native byte order:
+ *   magic[4], version (u32), config_hash (u64), item count (u32)
+ * then for each item:
+ *   update time sec, nsec (u32, u32), match count (u32), matches (u8 each),
+ *   status length (u32), status (ros::serialization of DiagnosticStatus)
+ */
+
+template <typename T>
+void putValue(vector<uint8_t> &buffer, T value)
+{
+  const uint8_t *bytes = reinterpret_cast<const uint8_t*>(&value);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+bool getValue(const uint8_t *&pos, const uint8_t *end, T &value)
+{
+  if (end - pos < (ptrdiff_t)sizeof(T))
+    return false;
+  memcpy(&value, pos, sizeof(T));
+  pos += sizeof(T);
+  return true;
+}
+
+}
+
+uint64_t diagnostic_aggregator::snapshotConfigHash(const string &config)
+{
+  // 64 bit FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for (string::size_type i = 0; i < config.size(); ++i)
+  {
+    hash ^= (uint8_t)config[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+bool diagnostic_aggregator::writeSnapshot(const string &path, uint64_t config_hash,
+                                          const vector<SnapshotItem> &items)
+{
+  vector<uint8_t> buffer;
+  buffer.insert(buffer.end(), SNAPSHOT_MAGIC, SNAPSHOT_MAGIC + sizeof(SNAPSHOT_MAGIC));
+  putValue(buffer, SNAPSHOT_VERSION);
+  putValue(buffer, config_hash);
+  putValue(buffer, (uint32_t)items.size());
+
+  for (unsigned int i = 0; i < items.size(); ++i)
+  {
+    ros::Time update_time = items[i].item->getLastUpdateTime();
+    putValue(buffer, update_time.sec);
+    putValue(buffer, update_time.nsec);
+
+    putValue(buffer, (uint32_t)items[i].matches.size());
+    for (unsigned int j = 0; j < items[i].matches.size(); ++j)
+      buffer.push_back(items[i].matches[j] ? 1 : 0);
+
+    diagnostic_msgs::DiagnosticStatus status = items[i].item->toRawStatusMsg();
+    uint32_t length = ros::serialization::serializationLength(status);
+    putValue(buffer, length);
+
+    size_t offset = buffer.size();
+    buffer.resize(offset + length);
+    ros::serialization::OStream stream(&buffer[offset], length);
+    ros::serialization::serialize(stream, status);
+  }
+
+  string tmp_path = path + ".tmp";
+  int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    ROS_ERROR("Unable to open diagnostic snapshot file %s for writing.", tmp_path.c_str());
+    return false;
+  }
+
+  // On disk before the rename, or a crash could leave an empty file under path
+  size_t written = 0;
+  while (written < buffer.size())
+  {
+    ssize_t n = write(fd, &buffer[written], buffer.size() - written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    written += n;
+  }
+  bool synced = written == buffer.size() && fsync(fd) == 0;
+  if (close(fd) != 0 || !synced)
+  {
+    ROS_ERROR("Unable to write diagnostic snapshot file %s.", tmp_path.c_str());
+    unlink(tmp_path.c_str());
+    return false;
+  }
+
+  if (rename(tmp_path.c_str(), path.c_str()) != 0)
+  {
+    ROS_ERROR("Unable to rename diagnostic snapshot %s to %s.", tmp_path.c_str(), path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool diagnostic_aggregator::readSnapshot(const string &path, uint64_t config_hash,
+                                         vector<SnapshotItem> &items)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  size_t size = file_stat.st_size;
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    ROS_ERROR("Unable to map diagnostic snapshot file %s.", path.c_str());
+    return false;
+  }
+
+  const uint8_t *pos = static_cast<const uint8_t*>(map);
+  const uint8_t *end = pos + size;
+
+  bool ok = true;
+  uint32_t version = 0, count = 0;
+  uint64_t file_hash = 0;
+  if (size < sizeof(SNAPSHOT_MAGIC) || memcmp(pos, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+    ok = false;
+  else
+  {
+    pos += sizeof(SNAPSHOT_MAGIC);
+    ok = getValue(pos, end, version) && version == SNAPSHOT_VERSION &&
+      getValue(pos, end, file_hash) && getValue(pos, end, count);
+  }
+
+  if (!ok)
+    ROS_WARN("File %s is not a diagnostic snapshot of this version, ignoring it.", path.c_str());
+
+  bool use_matches = file_hash == config_hash;
+  try
+  {
+    for (uint32_t i = 0; ok && i < count; ++i)
+    {
+      ros::Time update_time;
+      uint32_t num_matches, length;
+      if (!getValue(pos, end, update_time.sec) || !getValue(pos, end, update_time.nsec) ||
+          !getValue(pos, end, num_matches) || end - pos < (ptrdiff_t)num_matches)
+      {
+        ok = false;
+        break;
+      }
+
+      SnapshotItem snap;
+      if (use_matches)
+      {
+        for (uint32_t j = 0; j < num_matches; ++j)
+          snap.matches.push_back(pos[j] != 0);
+      }
+      pos += num_matches;
+
+      if (!getValue(pos, end, length) || end - pos < (ptrdiff_t)length)
+      {
+        ok = false;
+        break;
+      }
+
+      diagnostic_msgs::DiagnosticStatus status;
+      ros::serialization::IStream stream(const_cast<uint8_t*>(pos), length);
+      ros::serialization::deserialize(stream, status);
+      pos += length;
+
+      snap.item.reset(new StatusItem(&status, update_time));
+      items.push_back(snap);
+    }
+  }
+  catch (std::exception &e)
+  {
+    // ros::serialization throws if a status overruns its length
+    ROS_WARN("Unable to read a status of diagnostic snapshot %s: %s", path.c_str(), e.what());
+    ok = false;
+  }
+
+  munmap(map, size);
+
+  if (!ok)
+  {
+    ROS_WARN("Diagnostic snapshot file %s is truncated or corrupt, ignoring it.", path.c_str());
+    items.clear();
+  }
+
+  return ok;
+}
@@ -0,0 +1,145 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include "diagnostic_aggregator/statistics_analyzer.h"
+#include <cstdio>
+#include <limits>
+
+using namespace diagnostic_aggregator;
+using namespace std;
+
+PLUGINLIB_EXPORT_CLASS(diagnostic_aggregator::StatisticsAnalyzer,
+                       diagnostic_aggregator::Analyzer)
+
+namespace
+{
+
+void addValue(diagnostic_msgs::DiagnosticStatus &status, const string &key, double value)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%g", value);
+
+  diagnostic_msgs::KeyValue kv;
+  kv.key = key;
+  kv.value = buf;
+  status.values.push_back(kv);
+}
+
+void addCount(diagnostic_msgs::DiagnosticStatus &status, const string &key, unsigned int count)
+{
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u", count);
+
+  diagnostic_msgs::KeyValue kv;
+  kv.key = key;
+  kv.value = buf;
+  status.values.push_back(kv);
+}
+
+}
+
+StatisticsAnalyzer::StatisticsAnalyzer() { }
+
+StatisticsAnalyzer::~StatisticsAnalyzer() { }
+
+bool StatisticsAnalyzer::init(const string base_path, const ros::NodeHandle &n)
+{
+  if (!GenericAnalyzer::init(base_path, n))
+    return false;
+
+  XmlRpc::XmlRpcValue statistics;
+  if (!n.getParam("statistics", statistics))
+  {
+    ROS_ERROR("StatisticsAnalyzer was not given parameter \"statistics\". Namespace: %s",
+              n.getNamespace().c_str());
+    return false;
+  }
+
+  getParamVals(statistics, keys_);
+  for (unsigned int k = 0; k < keys_.size(); ++k)
+    columns_.push_back(addColumn(keys_[k]));
+
+  return true;
+}
+
+vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > StatisticsAnalyzer::report()
+{
+  vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > processed = GenericAnalyzer::report();
+  if (processed.empty() || processed[0]->name != path_)
+    return processed;
+
+  diagnostic_msgs::DiagnosticStatus &header = *processed[0];
+
+  // Stale items are left out by masking their values
+  const vector<char> &stale = getReportStale();
+
+  for (unsigned int k = 0; k < keys_.size(); ++k)
+  {
+    const vector<double> &column = getColumn(columns_[k]);
+    const double *values = column.empty() ? NULL : &column[0];
+    const char *mask = stale.empty() ? NULL : &stale[0];
+    unsigned int n = column.size();
+
+    double min = numeric_limits<double>::infinity();
+    double max = -numeric_limits<double>::infinity();
+    double sum = 0;
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < n; ++i)
+    {
+      // NaN fails the comparison, so missing values are masked too
+      bool use = !mask[i] && values[i] == values[i];
+      double v = use ? values[i] : 0.0;
+      min = use && v < min ? v : min;
+      max = use && v > max ? v : max;
+      sum += v;
+      count += use;
+    }
+
+    addCount(header, keys_[k] + " count", count);
+    if (count == 0)
+      continue;
+
+    addValue(header, keys_[k] + " min", min);
+    addValue(header, keys_[k] + " max", max);
+    addValue(header, keys_[k] + " mean", sum / count);
+  }
+
+  const LevelSummary &summary = getReportSummary();
+  addCount(header, "Items OK", summary.counts[Level_OK]);
+  addCount(header, "Items warning", summary.counts[Level_Warn]);
+  addCount(header, "Items error", summary.counts[Level_Error]);
+  addCount(header, "Items stale", summary.counts[Level_Stale]);
+
+  return processed;
+}
@@ -35,29 +35,83 @@
 /**!< \author Kevin Watts */
 
 #include <diagnostic_aggregator/status_item.h>
+#include <algorithm>
+#include <cctype>
+#include <locale>
+#include <sstream>
+#include <boost/atomic.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/math/special_functions/fpclassify.hpp>
 
 using namespace diagnostic_aggregator;
 using namespace std;
 
+// Weights of a new interval in the moving averages, about 1 / number of updates averaged
+static const float RECENT_INTERVAL_WEIGHT = 0.25f;
+static const float USUAL_INTERVAL_WEIGHT = 0.02f;
+static const float DEGRADED_USUAL_INTERVAL_WEIGHT = 0.002f;
+
+// Items are updated from the threads of several shards
+static boost::atomic<uint64_t> last_version(0);
+
+static uint64_t nextVersion()
+{
+  return ++last_version;
+}
+
 StatusItem::StatusItem(const diagnostic_msgs::DiagnosticStatus *status)
 {
   level_ = valToLevel(status->level);
+  previous_level_ = Level_Stale;
   name_ = status->name;
   message_ = status->message;
   hw_id_ = status->hardware_id;
   values_ = status->values;
+  content_hash_ = hashContent(*status);
+  version_ = nextVersion();
+  recent_interval_ = 0;
+  usual_interval_ = 0;
+  watch_factor_ = 0;
+  indexValues();
   
   output_name_ = getOutputName(name_);
   
   update_time_ = ros::Time::now();
 }
 
+StatusItem::StatusItem(const diagnostic_msgs::DiagnosticStatus *status, const ros::Time &update_time)
+{
+  level_ = valToLevel(status->level);
+  previous_level_ = Level_Stale;
+  name_ = status->name;
+  message_ = status->message;
+  hw_id_ = status->hardware_id;
+  values_ = status->values;
+  content_hash_ = hashContent(*status);
+  version_ = nextVersion();
+  recent_interval_ = 0;
+  usual_interval_ = 0;
+  watch_factor_ = 0;
+  indexValues();
+
+  output_name_ = getOutputName(name_);
+
+  update_time_ = update_time;
+}
+
 StatusItem::StatusItem(const string item_name, const string message, const DiagnosticLevel level)
 {
   name_ = item_name;
   message_ = message;
   level_ = level;
+  previous_level_ = Level_Stale;
   hw_id_ = "";
+  content_hash_ = hashContent(toRawStatusMsg());
+  version_ = nextVersion();
+  recent_interval_ = 0;
+  usual_interval_ = 0;
+  watch_factor_ = 0;
+  indexValues();
   
   output_name_ = getOutputName(name_);
 
@@ -74,31 +128,250 @@ bool StatusItem::update(const diagnostic_msgs::DiagnosticStatus *status)
     return false;
   }
 
-  double update_interval = (ros::Time::now() - update_time_).toSec();
+  ros::Time now = ros::Time::now();
+  double update_interval = (now - update_time_).toSec();
   if (update_interval < 0)
     ROS_WARN("StatusItem is being updated with older data. Negative update time: %f", update_interval);
+  else if (usual_interval_ == 0)
+  {
+    recent_interval_ = update_interval;
+    usual_interval_ = update_interval;
+  }
+  else
+  {
+    // As the analyzers would have seen it just before this update
+    bool degraded = watch_factor_ > 0 && isRateDegraded(watch_factor_, now);
+    float usual_weight = degraded ? DEGRADED_USUAL_INTERVAL_WEIGHT : USUAL_INTERVAL_WEIGHT;
+
+    recent_interval_ += RECENT_INTERVAL_WEIGHT * (update_interval - recent_interval_);
+    usual_interval_ += usual_weight * (update_interval - usual_interval_);
+  }
+
+  previous_level_ = level_;
+  update_time_ = now;
 
+  // Most statuses are sent again unchanged
+  size_t hash = hashContent(*status);
+  if (hash == content_hash_ && sameContent(*status))
+    return true;
+
+  content_hash_ = hash;
+  version_ = nextVersion();
   level_ = valToLevel(status->level);
   message_ = status->message;
   hw_id_ = status->hardware_id;
   values_ = status->values;
+  indexValues();
 
-  update_time_ = ros::Time::now();
+  if (history_)
+    history_->add(update_time_, level_, message_);
 
   return true;
 }
 
+bool StatusItem::isRateDegraded(double factor, const ros::Time &now) const
+{
+  if (usual_interval_ <= 0)
+    return false;
+
+  double interval = max((double)recent_interval_, (now - update_time_).toSec());
+  return interval > factor * usual_interval_;
+}
+
+void StatusItem::watchRate(double factor)
+{
+  if (factor > 0 && (watch_factor_ == 0 || factor < watch_factor_))
+    watch_factor_ = factor;
+}
+
+void StatusItem::enableHistory(unsigned int capacity, const boost::shared_ptr<HistoryMessages> &messages)
+{
+  history_.reset(new ItemHistory(capacity, messages));
+  history_->add(update_time_, level_, message_);
+}
+
+namespace
+{
+
+// Below this many values, a linear search is faster than building the index
+const unsigned int MIN_INDEXED_VALUES = 8;
+
+struct KeyIndexLess
+{
+  KeyIndexLess(const vector<diagnostic_msgs::KeyValue> &values) : values(values) { }
+
+  bool operator()(unsigned int a, unsigned int b) const { return values[a].key < values[b].key; }
+  bool operator()(unsigned int a, const string &key) const { return values[a].key < key; }
+
+  const vector<diagnostic_msgs::KeyValue> &values;
+};
+
+}
+
+size_t StatusItem::hashContent(const diagnostic_msgs::DiagnosticStatus &status)
+{
+  size_t hash = 0;
+  boost::hash_combine(hash, (int)valToLevel(status.level));
+  boost::hash_combine(hash, status.message);
+  boost::hash_combine(hash, status.hardware_id);
+  for (unsigned int i = 0; i < status.values.size(); ++i)
+  {
+    boost::hash_combine(hash, status.values[i].key);
+    boost::hash_combine(hash, status.values[i].value);
+  }
+  return hash;
+}
+
+bool StatusItem::sameContent(const diagnostic_msgs::DiagnosticStatus &status) const
+{
+  if (valToLevel(status.level) != level_ || status.message != message_ || status.hardware_id != hw_id_ ||
+      status.values.size() != values_.size())
+    return false;
+
+  for (unsigned int i = 0; i < values_.size(); ++i)
+  {
+    if (status.values[i].key != values_[i].key || status.values[i].value != values_[i].value)
+      return false;
+  }
+
+  return true;
+}
+
+int StatusItem::findKey(const string &key) const
+{
+  if (values_.size() < MIN_INDEXED_VALUES)
+  {
+    for (unsigned int i = 0; i < values_.size(); ++i)
+    {
+      if (values_[i].key == key)
+        return i;
+    }
+
+    return -1;
+  }
+
+  KeyIndexLess less(values_);
+  vector<unsigned int>::const_iterator it = lower_bound(key_index_.begin(), key_index_.end(), key, less);
+  if (it == key_index_.end() || values_[*it].key != key)
+    return -1;
+
+  return *it;
+}
+
+namespace
+{
+
+// Skips the digits at pos, returns how many there were
+unsigned int skipDigits(const char *&pos)
+{
+  const char *begin = pos;
+  while (isdigit((unsigned char)*pos))
+    ++pos;
+  return pos - begin;
+}
+
+/*
+ * Parses a decimal number, which may be followed by a space and anything else,
+ * like a unit. strtod isn't used, it would take the decimal point of the locale,
+ * and also accept "inf", "nan" and hexadecimal numbers.
+ */
+bool parseNumber(const string &str, double &value)
+{
+  const char *begin = str.c_str();
+  while (isspace((unsigned char)*begin))
+    ++begin;
+
+  const char *pos = begin;
+  if (*pos == '+' || *pos == '-')
+    ++pos;
+  unsigned int digits = skipDigits(pos);
+  if (*pos == '.')
+  {
+    ++pos;
+    digits += skipDigits(pos);
+  }
+  if (digits == 0)
+    return false;
+
+  if (*pos == 'e' || *pos == 'E')
+  {
+    ++pos;
+    if (*pos == '+' || *pos == '-')
+      ++pos;
+    if (skipDigits(pos) == 0)
+      return false;
+  }
+
+  if (*pos != '\0' && !isspace((unsigned char)*pos))
+    return false;
+
+  istringstream stream(string(begin, pos));
+  stream.imbue(locale::classic());
+  stream >> value;
+
+  // Out of range numbers fail or are infinite
+  return !stream.fail() && boost::math::isfinite(value);
+}
+
+}
+
+bool StatusItem::getNumericValue(const string &key, double &value) const
+{
+  int i = findKey(key);
+  if (i < 0)
+    return false;
+
+  value = numeric_values_[i];
+  return numeric_valid_[i] != 0;
+}
+
+void StatusItem::indexValues()
+{
+  key_index_.clear();
+  if (values_.size() >= MIN_INDEXED_VALUES)
+  {
+    key_index_.resize(values_.size());
+    for (unsigned int i = 0; i < values_.size(); ++i)
+      key_index_[i] = i;
+
+    // Stable, so the first of duplicate keys is found, like the linear search
+    stable_sort(key_index_.begin(), key_index_.end(), KeyIndexLess(values_));
+  }
+
+  numeric_values_.assign(values_.size(), 0);
+  numeric_valid_.assign(values_.size(), 0);
+  for (unsigned int i = 0; i < values_.size(); ++i)
+    numeric_valid_[i] = parseNumber(values_[i].value, numeric_values_[i]) ? 1 : 0;
+}
+
 boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> StatusItem::toStatusMsg(const std::string &path, bool stale) const
 {
-  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> status(new diagnostic_msgs::DiagnosticStatus());
+  return toStatusMsg(path, stale, level_, message_);
+}
+
+boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> StatusItem::toStatusMsg(const std::string &path, bool stale,
+                                                                             int8_t level, const std::string &message) const
+{
+  StatusMsgSource source;
+  source.version = version_;
+  source.stale = stale;
+  source.override_hash = 0;
+  if (level != level_ || message != message_)
+  {
+    boost::hash_combine(source.override_hash, level);
+    boost::hash_combine(source.override_hash, message);
+    if (source.override_hash == 0)
+      source.override_hash = 1;
+  }
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> status(new diagnostic_msgs::DiagnosticStatus(), source);
 
   if (path == "/")
     status->name = "/" + output_name_;
   else
     status->name = path + "/" + output_name_;
 
-  status->level = level_;
-  status->message = message_;
+  status->level = level;
+  status->message = message;
   status->hardware_id = hw_id_;
   status->values = values_;
 
@@ -108,3 +381,14 @@ boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> StatusItem::toStatusMsg(con
   return status;
 }
 
+diagnostic_msgs::DiagnosticStatus StatusItem::toRawStatusMsg() const
+{
+  diagnostic_msgs::DiagnosticStatus status;
+  status.name = name_;
+  status.level = level_;
+  status.message = message_;
+  status.hardware_id = hw_id_;
+  status.values = values_;
+
+  return status;
+}
@@ -0,0 +1,168 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include "diagnostic_aggregator/threshold_analyzer.h"
+#include <cstdio>
+#include <limits>
+
+using namespace diagnostic_aggregator;
+using namespace std;
+
+PLUGINLIB_EXPORT_CLASS(diagnostic_aggregator::ThresholdAnalyzer,
+                       diagnostic_aggregator::Analyzer)
+
+namespace
+{
+
+bool getNumber(XmlRpc::XmlRpcValue &param, const string &name, double &value)
+{
+  if (!param.hasMember(name))
+    return false;
+
+  XmlRpc::XmlRpcValue &number = param[name];
+  if (number.getType() == XmlRpc::XmlRpcValue::TypeDouble)
+    value = static_cast<double>(number);
+  else if (number.getType() == XmlRpc::XmlRpcValue::TypeInt)
+    value = static_cast<int>(number);
+  else
+  {
+    ROS_ERROR("ThresholdAnalyzer threshold \"%s\" is not a number.", name.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+}
+
+ThresholdAnalyzer::ThresholdAnalyzer() { }
+
+ThresholdAnalyzer::~ThresholdAnalyzer() { }
+
+bool ThresholdAnalyzer::parseRule(XmlRpc::XmlRpcValue &param, ThresholdRule &rule)
+{
+  if (param.getType() != XmlRpc::XmlRpcValue::TypeStruct || !param.hasMember("key") ||
+      param["key"].getType() != XmlRpc::XmlRpcValue::TypeString)
+  {
+    ROS_ERROR("ThresholdAnalyzer threshold rules must have a \"key\".");
+    return false;
+  }
+
+  rule.key = static_cast<string>(param["key"]);
+
+  double inf = numeric_limits<double>::infinity();
+  rule.warn_above = rule.error_above = inf;
+  rule.warn_below = rule.error_below = -inf;
+
+  bool has_threshold = false;
+  has_threshold |= getNumber(param, "warn_above", rule.warn_above);
+  has_threshold |= getNumber(param, "error_above", rule.error_above);
+  has_threshold |= getNumber(param, "warn_below", rule.warn_below);
+  has_threshold |= getNumber(param, "error_below", rule.error_below);
+
+  if (!has_threshold)
+  {
+    ROS_ERROR("ThresholdAnalyzer threshold rule for key \"%s\" has no thresholds.", rule.key.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool ThresholdAnalyzer::init(const string base_path, const ros::NodeHandle &n)
+{
+  if (!GenericAnalyzer::init(base_path, n))
+    return false;
+
+  XmlRpc::XmlRpcValue thresholds;
+  if (!n.getParam("thresholds", thresholds) || thresholds.getType() != XmlRpc::XmlRpcValue::TypeArray)
+  {
+    ROS_ERROR("ThresholdAnalyzer was not given a list of \"thresholds\". Namespace: %s",
+              n.getNamespace().c_str());
+    return false;
+  }
+
+  for (int i = 0; i < thresholds.size(); ++i)
+  {
+    ThresholdRule rule;
+    if (!parseRule(thresholds[i], rule))
+    {
+      ROS_ERROR("Invalid threshold rule %d of ThresholdAnalyzer. Namespace: %s", i, n.getNamespace().c_str());
+      return false;
+    }
+    rules_.push_back(rule);
+  }
+
+  return true;
+}
+
+int8_t ThresholdAnalyzer::raisedLevel(const StatusItem &item, string &message) const
+{
+  int8_t level = item.getLevel();
+  char buf[64];
+
+  for (unsigned int i = 0; i < rules_.size(); ++i)
+  {
+    const ThresholdRule &rule = rules_[i];
+
+    double value;
+    if (!item.getNumericValue(rule.key, value))
+      continue;
+
+    int8_t rule_level = Level_OK;
+    const char *direction = "";
+    double threshold = 0;
+    if (value > rule.error_above || value < rule.error_below)
+    {
+      rule_level = Level_Error;
+      direction = value > rule.error_above ? "above" : "below";
+      threshold = value > rule.error_above ? rule.error_above : rule.error_below;
+    }
+    else if (value > rule.warn_above || value < rule.warn_below)
+    {
+      rule_level = Level_Warn;
+      direction = value > rule.warn_above ? "above" : "below";
+      threshold = value > rule.warn_above ? rule.warn_above : rule.warn_below;
+    }
+
+    if (rule_level > level)
+    {
+      level = rule_level;
+      snprintf(buf, sizeof(buf), " %g %s %g", value, direction, threshold);
+      message = rule.key + buf;
+    }
+  }
+
+  return level;
+}
@@ -0,0 +1,247 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <map>
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+#include "diagnostic_aggregator/upstream_analyzer.h"
+
+using namespace diagnostic_aggregator;
+using namespace std;
+
+PLUGINLIB_EXPORT_CLASS(diagnostic_aggregator::UpstreamAnalyzer,
+                       diagnostic_aggregator::Analyzer)
+
+namespace diagnostic_aggregator {
+
+/*!
+ *\brief Latest statuses of an upstream topic, shared by the analyzers of that topic
+ */
+class UpstreamCache
+{
+public:
+  UpstreamCache(bool delta) : delta(delta) { }
+
+  /*!
+   *\brief Stores the latest upstream statuses
+   */
+  void callback(const diagnostic_msgs::DiagnosticArray::ConstPtr& msg);
+
+  /*!
+   *\brief Upstream status and the time it was last received
+   */
+  struct Item
+  {
+    diagnostic_msgs::DiagnosticStatus status;
+    ros::Time update_time;
+  };
+
+  const bool delta;
+  ros::Subscriber sub;
+
+  boost::mutex mutex; /**< Guards items and last_update */
+  map<string, Item> items; /**< Keyed by upstream name */
+  ros::Time last_update;
+};
+
+}
+
+/*!
+ *\brief Resolved topic and delta prune time, negative for full arrays
+ */
+typedef pair<string, double> CacheKey;
+
+static boost::mutex caches_mutex;
+static map<CacheKey, boost::weak_ptr<UpstreamCache> > caches; /**< Guarded by caches_mutex */
+
+/*!
+ *\brief Returns the cache of a topic, subscribes if no analyzer has one yet
+ *
+ * The cache is released, and unsubscribed, with the last analyzer using it.
+ */
+static boost::shared_ptr<UpstreamCache> getCache(const string &topic, bool delta, double delta_prune_time)
+{
+  // Resolve the topic in the node namespace, not the analyzer parameters
+  ros::NodeHandle nh;
+  CacheKey key(nh.resolveName(topic), delta ? delta_prune_time : -1.0);
+
+  boost::mutex::scoped_lock lock(caches_mutex);
+  map<CacheKey, boost::weak_ptr<UpstreamCache> >::iterator it = caches.begin();
+  while (it != caches.end())
+  {
+    if (it->second.expired())
+      caches.erase(it++);
+    else
+      ++it;
+  }
+
+  boost::shared_ptr<UpstreamCache> cache = caches[key].lock();
+  if (!cache)
+  {
+    cache.reset(new UpstreamCache(delta));
+    cache->sub = nh.subscribe(key.first, 10, &UpstreamCache::callback, cache.get());
+    caches[key] = cache;
+  }
+  return cache;
+}
+
+UpstreamAnalyzer::UpstreamAnalyzer() :
+  timeout_(5.0),
+  delta_prune_time_(30.0),
+  delta_(false)
+{ }
+
+UpstreamAnalyzer::~UpstreamAnalyzer() { }
+
+bool UpstreamAnalyzer::init(const string base_path, const ros::NodeHandle &n)
+{
+  if (!n.getParam("path", nice_name_))
+  {
+    ROS_ERROR("UpstreamAnalyzer was not given parameter \"path\". Namespace: %s",
+              n.getNamespace().c_str());
+    return false;
+  }
+
+  if (!n.getParam("topic", topic_))
+  {
+    ROS_ERROR("UpstreamAnalyzer was not given parameter \"topic\". Namespace: %s",
+              n.getNamespace().c_str());
+    return false;
+  }
+
+  n.param("timeout", timeout_, 5.0);
+  n.param("delta", delta_, false);
+  n.param("delta_prune_time", delta_prune_time_, 30.0);
+
+  if (base_path == "/")
+    path_ = nice_name_;
+  else
+    path_ = base_path + "/" + nice_name_;
+
+  if (path_.find("/") != 0)
+    path_ = "/" + path_;
+
+  cache_ = getCache(topic_, delta_, delta_prune_time_);
+
+  return true;
+}
+
+void UpstreamCache::callback(const diagnostic_msgs::DiagnosticArray::ConstPtr& msg)
+{
+  boost::mutex::scoped_lock lock(mutex);
+  ros::Time now = ros::Time::now();
+  last_update = now;
+
+  // A full array replaces everything we had
+  if (!delta)
+    items.clear();
+
+  for (unsigned int i = 0; i < msg->status.size(); ++i)
+  {
+    Item &item = items[msg->status[i].name];
+    item.status = msg->status[i];
+    item.update_time = now;
+  }
+}
+
+vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > UpstreamAnalyzer::report()
+{
+  vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > processed;
+
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> header_status(new diagnostic_msgs::DiagnosticStatus);
+  header_status->name = path_;
+  header_status->level = Level_OK;
+  processed.push_back(header_status);
+
+  // Copies of other shards report the same cache, merging them gives the same statuses
+  boost::mutex::scoped_lock lock(cache_->mutex);
+  ros::Time now = ros::Time::now();
+
+  if (cache_->last_update.isZero())
+  {
+    header_status->level = Level_Stale;
+    header_status->message = "No data from " + topic_;
+    return processed;
+  }
+
+  bool stale = (now - cache_->last_update).toSec() > timeout_;
+  bool all_stale = true;
+
+  map<string, UpstreamCache::Item>::iterator it = cache_->items.begin();
+  while (it != cache_->items.end())
+  {
+    if (delta_ && (now - it->second.update_time).toSec() > delta_prune_time_)
+    {
+      cache_->items.erase(it++);
+      continue;
+    }
+
+    boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> status(
+      new diagnostic_msgs::DiagnosticStatus(it->second.status));
+
+    // Upstream names already start with "/"
+    if (path_ == "/")
+      status->name = it->first;
+    else
+      status->name = path_ + it->first;
+
+    if (stale)
+      status->level = Level_Stale;
+
+    // Only the top-level statuses of the upstream aggregator go into the header
+    if (it->first.find("/", 1) == string::npos)
+    {
+      header_status->level = max(header_status->level, status->level);
+      all_stale = all_stale && status->level == Level_Stale;
+
+      diagnostic_msgs::KeyValue kv;
+      kv.key = it->first.substr(1);
+      kv.value = status->message;
+      header_status->values.push_back(kv);
+    }
+
+    processed.push_back(status);
+    ++it;
+  }
+
+  // Header is not stale unless all subs are
+  if (all_stale)
+    header_status->level = Level_Stale;
+  else if (header_status->level == Level_Stale)
+    header_status->level = Level_Error;
+
+  header_status->message = valToMsg(header_status->level);
+
+  return processed;
+}
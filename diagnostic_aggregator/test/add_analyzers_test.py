@@ -35,7 +35,10 @@
 import unittest
 import rospy, rostest
 import rosparam
+import rospkg
 import optparse
+import os
+import imp
 import sys
 import threading
 from bondpy import bondpy
@@ -55,6 +58,7 @@ class TestAddAnalyzer(unittest.TestCase):
 
         self._mutex = threading.Lock()
         self.agg_msgs = {}
+        self._bond_broken = False
 
         # put parameters in the node namespace so they can be read by the aggregator
         for params, ns in paramlist:
@@ -72,7 +76,13 @@ class TestAddAnalyzer(unittest.TestCase):
         """Start a bond to the aggregator
         """
         namespace = rospy.resolve_name(rospy.get_name())
-        self.bond = bondpy.Bond("/diagnostics_agg/bond" + namespace, namespace)
+        if rospy.get_param('~shared_bond', False):
+            # The client of the add_analyzers script
+            script = os.path.join(rospkg.RosPack().get_path(PKG), 'scripts', 'add_analyzers')
+            add_analyzers = imp.load_source('add_analyzers', script)
+            self.bond = add_analyzers.SharedBond(namespace, self.bond_broken)
+        else:
+            self.bond = bondpy.Bond("/diagnostics_agg/bond" + namespace, namespace)
         self.bond.start()
         rospy.wait_for_service('/diagnostics_agg/add_diagnostics', timeout=10)
         add_diagnostics = rospy.ServiceProxy('/diagnostics_agg/add_diagnostics', AddDiagnostics)
@@ -80,6 +90,10 @@ class TestAddAnalyzer(unittest.TestCase):
         resp = add_diagnostics(load_namespace=self.namespace)
         self.assert_(resp.success, 'Service call was unsuccessful: {0}'.format(resp.message))
 
+    def bond_broken(self):
+        with self._mutex:
+            self._bond_broken = True
+
     def wait_for_agg(self):
         self.agg_msgs = {}
         while not self.agg_msgs and not rospy.is_shutdown():
@@ -124,6 +138,9 @@ class TestAddAnalyzer(unittest.TestCase):
             self.assert_(all(expected in agg_paths for expected in self.expected))
                 
 
+        with self._mutex:
+            self.assert_(not self._bond_broken, 'Bond broken by the aggregator')
+
         self.bond.shutdown()
         rospy.sleep(rospy.Duration(5)) # wait a bit for the analyzers to unload
         self.wait_for_agg()
@@ -0,0 +1,257 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <diagnostic_aggregator/analyzer_group.h>
+#include <diagnostic_aggregator/generic_analyzer_base.h>
+#include <ros/ros.h>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "test_helpers.h"
+
+using namespace std;
+using namespace diagnostic_aggregator;
+
+/*!
+ *\brief Analyzer written against the version 1 functions, counts the calls to them
+ */
+class VersionOneAnalyzer : public GenericAnalyzerBase
+{
+public:
+  VersionOneAnalyzer() : matched(0), analyzed(0) { }
+
+  bool init(const string base_path, const ros::NodeHandle &n)
+  {
+    return GenericAnalyzerBase::init(base_path + "/Counted", "Counted");
+  }
+
+  bool match(const string name)
+  {
+    ++matched;
+    return name == "counted";
+  }
+
+  bool analyze(const boost::shared_ptr<StatusItem> item)
+  {
+    ++analyzed;
+    return GenericAnalyzerBase::analyze(item);
+  }
+
+  unsigned int matched;
+  unsigned int analyzed;
+};
+
+// The group calls matchRef() and analyzeRef(), which must reach the version 1 overrides
+TEST(AnalyzerGroup, versionOneOverrides)
+{
+  ros::NodeHandle nh = ros::NodeHandle("~");
+
+  AnalyzerGroup group;
+  ASSERT_TRUE(group.init("/Robot", nh));
+
+  VersionOneAnalyzer *counted = new VersionOneAnalyzer;
+  boost::shared_ptr<Analyzer> analyzer(counted);
+  ASSERT_TRUE(analyzer->init("/Robot", nh));
+  ASSERT_TRUE(group.addAnalyzer(analyzer));
+
+  boost::shared_ptr<StatusItem> item = makeItem("counted", Level_Warn);
+  EXPECT_TRUE(group.matchRef("counted"));
+  EXPECT_TRUE(group.analyzeRef(item));
+  EXPECT_EQ(1u, counted->matched);
+  EXPECT_EQ(1u, counted->analyzed);
+
+  boost::shared_ptr<StatusItem> other = makeItem("motor", Level_OK);
+  EXPECT_TRUE(group.matchRef("motor"));
+  EXPECT_TRUE(group.analyzeRef(other));
+  EXPECT_EQ(2u, counted->matched);
+  EXPECT_EQ(1u, counted->analyzed);
+
+  Report report = group.report();
+  EXPECT_EQ(Level_Warn, reportedLevel(report, "/Robot/Counted"));
+  EXPECT_EQ(Level_Warn, reportedLevel(report, "/Robot/Counted/counted"));
+  EXPECT_EQ(Level_OK, reportedLevel(report, "/Robot/Motors/motor"));
+}
+
+/*!
+ *\brief Value of key in the match cache status of group
+ */
+static string cacheValue(const AnalyzerGroup &group, const string &key)
+{
+  return findValue(*group.reportStats()[0], key);
+}
+
+// Past match_cache_bytes, the least recently used names are evicted
+TEST(AnalyzerGroup, matchCacheEviction)
+{
+  AnalyzerGroup group;
+  ASSERT_TRUE(group.init("/Robot", ros::NodeHandle("~small_cache")));
+
+  // Each entry takes 2 * 6 + 128 bytes, two fit
+  EXPECT_TRUE(group.matchRef("motor1"));
+  EXPECT_TRUE(group.matchRef("motor2"));
+  EXPECT_EQ("2", cacheValue(group, "cache entries"));
+  EXPECT_EQ("280", cacheValue(group, "cache bytes"));
+
+  EXPECT_TRUE(group.matchRef("motor1"));
+  EXPECT_TRUE(group.matchRef("motor3"));
+  EXPECT_EQ("2", cacheValue(group, "cache entries"));
+  EXPECT_EQ("280", cacheValue(group, "cache bytes"));
+  EXPECT_EQ("1", cacheValue(group, "cache evictions"));
+  EXPECT_TRUE(group.getMatches("motor2").empty());
+  EXPECT_FALSE(group.getMatches("motor1").empty());
+  EXPECT_FALSE(group.getMatches("motor3").empty());
+
+  // Now motor1 is the least recently used
+  EXPECT_TRUE(group.matchRef("motor2"));
+  EXPECT_TRUE(group.getMatches("motor1").empty());
+  EXPECT_EQ("2", cacheValue(group, "cache evictions"));
+  EXPECT_EQ("1", cacheValue(group, "cache hits"));
+  EXPECT_EQ("4", cacheValue(group, "cache misses"));
+
+  // Names that aren't matched are cached too, with their own length
+  EXPECT_FALSE(group.matchRef("fan"));
+  EXPECT_EQ("274", cacheValue(group, "cache bytes"));
+}
+
+// Names that miss again after they were evicted aren't counted as new names
+TEST(AnalyzerGroup, prefixWarning)
+{
+  AnalyzerGroup group;
+  ASSERT_TRUE(group.init("/Robot", ros::NodeHandle("~small_cache")));
+
+  for (int i = 0; i < 3; ++i)
+  {
+    group.matchRef("motor1");
+    group.matchRef("motor2");
+    group.matchRef("motor3");
+  }
+  EXPECT_EQ("9", cacheValue(group, "cache misses"));
+  EXPECT_EQ(Level_OK, group.reportStats()[0]->level);
+
+  group.matchRef("motor4");
+  EXPECT_EQ(Level_Warn, group.reportStats()[0]->level);
+}
+
+/*!
+ *\brief Profiling status of the analyzer with that path, NULL if there is none
+ */
+static boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> timingStatus(const AnalyzerGroup &group,
+                                                                         const string &path)
+{
+  return findStatus(group.reportStats(), path);
+}
+
+// With profile_analyzers, each sub-analyzer has a status with its call counts
+TEST(AnalyzerGroup, profiling)
+{
+  AnalyzerGroup plain;
+  ASSERT_TRUE(plain.init("/Robot", ros::NodeHandle("~")));
+  EXPECT_EQ(1u, plain.reportStats().size());
+
+  AnalyzerGroup group;
+  ASSERT_TRUE(group.init("/Robot", ros::NodeHandle("~profiled")));
+  ASSERT_EQ(3u, group.reportStats().size());
+  ASSERT_TRUE(timingStatus(group, "/Robot/Motors"));
+  ASSERT_TRUE(timingStatus(group, "/Robot/Fans"));
+  EXPECT_EQ("0", findValue(*timingStatus(group, "/Robot/Motors"), "match calls"));
+
+  // Both analyzers are asked to match, only motors analyzes
+  boost::shared_ptr<StatusItem> item = makeItem("motor1", Level_OK);
+  EXPECT_TRUE(group.matchRef("motor1"));
+  EXPECT_TRUE(group.analyzeRef(item));
+  EXPECT_TRUE(group.analyzeRef(item));
+  group.report();
+
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> motors = timingStatus(group, "/Robot/Motors");
+  EXPECT_EQ("1", findValue(*motors, "match calls"));
+  EXPECT_EQ("2", findValue(*motors, "analyze calls"));
+  EXPECT_EQ("1", findValue(*motors, "report calls"));
+  EXPECT_FALSE(findValue(*motors, "analyze mean (us)").empty());
+
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> fans = timingStatus(group, "/Robot/Fans");
+  EXPECT_EQ("1", findValue(*fans, "match calls"));
+  EXPECT_EQ("0", findValue(*fans, "analyze calls"));
+  EXPECT_EQ("0", findValue(*fans, "analyze mean (us)"));
+  EXPECT_EQ("1", findValue(*fans, "report calls"));
+}
+
+// Analyzing a batch must give the same results as analyzing the items one by one
+TEST(AnalyzerGroup, analyzeBatch)
+{
+  AnalyzerGroup batched, single;
+  ASSERT_TRUE(batched.init("/Robot", ros::NodeHandle("~batch")));
+  ASSERT_TRUE(single.init("/Robot", ros::NodeHandle("~batch")));
+
+  // Matched by one analyzer, by two, discarded, in a subgroup, by none
+  const char *names[] = { "motor1", "motor_drive", "wheel_drive", "fan", "camera", "battery", "motor2" };
+  const unsigned int count = 7;
+  for (int round = 0; round < 2; ++round)
+  {
+    vector<boost::shared_ptr<StatusItem> > items;
+    for (unsigned int i = 0; i < count; ++i)
+      items.push_back(makeItem(names[i], i % 2 ? Level_Warn : Level_OK, "Round", round ? "2" : "1"));
+
+    vector<bool> analyzed(count, true);
+    batched.analyzeBatch(&items[0], count, analyzed);
+
+    for (unsigned int i = 0; i < count; ++i)
+    {
+      bool expected = single.matchRef(names[i]) && single.analyzeRef(items[i]);
+      EXPECT_EQ(expected, analyzed[i]) << names[i];
+    }
+  }
+
+  Report batched_report = batched.report();
+  Report single_report = single.report();
+  ASSERT_EQ(single_report.size(), batched_report.size());
+  for (unsigned int i = 0; i < single_report.size(); ++i)
+  {
+    EXPECT_EQ(single_report[i]->name, batched_report[i]->name);
+    EXPECT_EQ(single_report[i]->level, batched_report[i]->level) << single_report[i]->name;
+    EXPECT_EQ(single_report[i]->message, batched_report[i]->message) << single_report[i]->name;
+    EXPECT_EQ(single_report[i]->values.size(), batched_report[i]->values.size()) << single_report[i]->name;
+  }
+  EXPECT_EQ(Level_Warn, reportedLevel(batched_report, "/Robot/Drives/motor_drive"));
+  EXPECT_EQ(Level_Warn, reportedLevel(batched_report, "/Robot/Motors/motor_drive"));
+  EXPECT_EQ("2", findValue(*findStatus(batched_report, "/Robot/Sensors/Cameras/camera"), "Round"));
+  EXPECT_FALSE(findStatus(batched_report, "/Robot/Fans/fan"));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "analyzer_group_test");
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,215 @@
+#!/usr/bin/env python
+# Software License Agreement (BSD License)
+#
+# Copyright (c) 2009, Willow Garage, Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above
+#    copyright notice, this list of conditions and the following
+#    disclaimer in the documentation and/or other materials provided
+#    with the distribution.
+#  * Neither the name of the Willow Garage nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+# FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+# COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+# INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+# ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+##\brief Tests that multiplexed bonds break on a timeout, and on an inactive status,
+## and that the aggregator sends one heartbeat for all of them
+
+from __future__ import with_statement
+PKG = 'diagnostic_aggregator'
+import roslib; roslib.load_manifest(PKG)
+import rospy, rostest, unittest
+import rosparam
+from bond.msg import Status
+from diagnostic_msgs.srv import AddDiagnostics
+from diagnostic_msgs.msg import DiagnosticArray, DiagnosticStatus
+import sys
+import threading
+import uuid
+
+BOND_TOPIC = '/diagnostics_agg/bond'
+HEARTBEAT_TOPIC = '/diagnostics_agg/bond_heartbeat'
+HEARTBEAT_TIMEOUT = 4.0 # Default of BondTracker
+
+class TestBondTracker(unittest.TestCase):
+    def __init__(self, *args):
+        super(TestBondTracker, self).__init__(*args)
+        rospy.init_node('test_bond_tracker')
+        self.namespace = rospy.get_name()
+        paramlist = rosparam.load_file(rospy.myargv()[1])
+        self.expected = [paramlist[0][1] + analyzer['path'] for name, analyzer in paramlist[0][0]['analyzers'].items()]
+
+        # Put the analyzers in the node namespace, so the aggregator can load them
+        for params, ns in paramlist:
+            rosparam.upload_params(self.namespace + '/' + ns, params)
+
+        self._mutex = threading.Lock()
+        self._agg = None
+        self._beating = False
+        self._instance_id = None
+        self._heartbeats = []
+        self._client_topic = []
+
+        rospy.Subscriber('/diagnostics_agg', DiagnosticArray, self.agg_cb)
+        rospy.Subscriber(HEARTBEAT_TOPIC, Status, self.heartbeat_cb)
+        rospy.Subscriber(BOND_TOPIC, Status, self.client_topic_cb)
+        self._diag_pub = rospy.Publisher('/diagnostics', DiagnosticArray, queue_size=1)
+        self._bond_pub = rospy.Publisher(BOND_TOPIC, Status, queue_size=10)
+        rospy.Timer(rospy.Duration(0.5), self.heartbeat)
+
+    def agg_cb(self, msg):
+        with self._mutex:
+            self._agg = [stat.name for stat in msg.status]
+
+    def heartbeat_cb(self, msg):
+        with self._mutex:
+            self._heartbeats.append(msg)
+
+    def client_topic_cb(self, msg):
+        with self._mutex:
+            self._client_topic.append(msg)
+
+    def heartbeat(self, event):
+        with self._mutex:
+            if self._beating:
+                self.publish_status(True)
+
+    def publish_status(self, active):
+        status = Status()
+        status.header.stamp = rospy.get_rostime()
+        status.id = self.namespace
+        status.instance_id = self._instance_id
+        status.active = active
+        status.heartbeat_timeout = HEARTBEAT_TIMEOUT
+        status.heartbeat_period = 1.0
+        self._bond_pub.publish(status)
+
+    def next_agg(self):
+        """Names in the next output of the aggregator"""
+        with self._mutex:
+            self._agg = None
+        while not rospy.is_shutdown():
+            rospy.sleep(rospy.Duration(0.2))
+            with self._mutex:
+                if self._agg is not None:
+                    return self._agg
+        return []
+
+    def added(self):
+        names = self.next_agg()
+        return all(expected in names for expected in self.expected)
+
+    def removed(self):
+        names = self.next_agg()
+        return not any(expected in names for expected in self.expected)
+
+    def add_analyzers(self):
+        """Bonds with the aggregator like a client, and waits for the analyzers"""
+        with self._mutex:
+            self._instance_id = str(uuid.uuid4())
+            self._beating = True
+
+        rospy.wait_for_service('/diagnostics_agg/add_diagnostics', timeout=10)
+        add_diagnostics = rospy.ServiceProxy('/diagnostics_agg/add_diagnostics', AddDiagnostics)
+        resp = add_diagnostics(load_namespace=self.namespace)
+        self.assert_(resp.success, 'Service call was unsuccessful: {0}'.format(resp.message))
+
+        arr = DiagnosticArray()
+        arr.status = [
+            DiagnosticStatus(name='primary', message='hello-primary'),
+            DiagnosticStatus(name='secondary', message='hello-secondary')
+        ]
+        deadline = rospy.get_time() + 10.0
+        while not rospy.is_shutdown() and rospy.get_time() < deadline:
+            arr.header.stamp = rospy.get_rostime()
+            self._diag_pub.publish(arr)
+            if self.added():
+                return
+        self.fail('Added analyzers not in the output')
+
+    def wait_removed(self, timeout):
+        deadline = rospy.get_time() + timeout
+        while not rospy.is_shutdown() and rospy.get_time() < deadline:
+            if self.removed():
+                return True
+        return False
+
+    def test_one_heartbeat(self):
+        self.add_analyzers()
+
+        with self._mutex:
+            self._heartbeats = []
+            self._client_topic = []
+        rospy.sleep(rospy.Duration(3.5))
+
+        with self._mutex:
+            # One for all clients per period, none for our id
+            self.assert_(3 <= len(self._heartbeats) <= 4,
+                         'Expected 3 aggregator heartbeats in 3.5 s, got %d' % len(self._heartbeats))
+            self.assert_(all(msg.id == '' and msg.active for msg in self._heartbeats),
+                         'Aggregator sent heartbeats of a single bond')
+            self.assert_(len(set(msg.instance_id for msg in self._heartbeats)) == 1,
+                         'Aggregator heartbeats from several instances')
+
+            # Only the clients send on the client topic
+            self.assert_(all(msg.instance_id == self._instance_id for msg in self._client_topic),
+                         'Aggregator sent on the client topic')
+
+            self._beating = False
+            self.publish_status(False)
+        self.assert_(self.wait_removed(HEARTBEAT_TIMEOUT - 1.0), 'Analyzers not removed')
+
+    def test_broken_by_inactive_status(self):
+        self.add_analyzers()
+
+        with self._mutex:
+            self._beating = False
+            self.publish_status(False)
+
+        # Well before the heartbeat timeout
+        self.assert_(self.wait_removed(HEARTBEAT_TIMEOUT - 1.0),
+                     'Analyzers not removed after the bond was broken by an inactive status')
+
+    def test_broken_by_timeout(self):
+        self.add_analyzers()
+
+        # Heartbeats stop without an inactive status, like a client that died
+        with self._mutex:
+            self._beating = False
+            self._heartbeats = []
+        stopped = rospy.get_time()
+
+        rospy.sleep(rospy.Duration(HEARTBEAT_TIMEOUT / 2))
+        self.assert_(self.added(), 'Analyzers removed before the heartbeat timeout')
+
+        self.assert_(self.wait_removed(HEARTBEAT_TIMEOUT + 5.0),
+                     'Analyzers not removed after the heartbeat timeout')
+        self.assert_(rospy.get_time() - stopped > HEARTBEAT_TIMEOUT - 1.0,
+                     'Analyzers removed before the heartbeat timeout')
+
+        # The client is told, in case it is still alive
+        with self._mutex:
+            self.assert_(any(msg.id == self.namespace and not msg.active for msg in self._heartbeats),
+                         'Timeout not announced on %s' % HEARTBEAT_TOPIC)
+
+if __name__ == '__main__':
+    rostest.run(PKG, sys.argv[0], TestBondTracker, sys.argv)
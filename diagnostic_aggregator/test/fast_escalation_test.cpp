@@ -0,0 +1,106 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <diagnostic_aggregator/aggregator.h>
+#include <ros/ros.h>
+#include <string>
+#include <gtest/gtest.h>
+#include "test_helpers.h"
+
+using namespace std;
+using namespace diagnostic_aggregator;
+
+namespace diagnostic_aggregator {
+
+/*!
+ *\brief Analyzes statuses and publishes, checking when a shard escalates
+ */
+class AggregatorTest : public testing::Test
+{
+protected:
+  /*!
+   *\brief Analyzes a status, returns true if that escalated the shard
+   */
+  bool analyze(const string &name, int8_t level)
+  {
+    diagnostic_msgs::DiagnosticArray::Ptr msg(new diagnostic_msgs::DiagnosticArray);
+    msg->status.push_back(makeStatus(name, level));
+
+    Aggregator::ShardWork work;
+    work.msg = msg;
+    work.indices.push_back(0);
+    work.publisher = "/publisher";
+
+    Aggregator::Shard &shard = *aggregator_.shards_[0];
+    boost::mutex::scoped_lock lock(shard.mutex);
+    aggregator_.analyzeStatuses(shard, work, NULL);
+    return aggregator_.checkEscalated(shard);
+  }
+
+  Aggregator aggregator_;
+};
+
+}
+
+// An item escalates when its level is above the one it was published with
+TEST_F(AggregatorTest, publishedLevels)
+{
+  EXPECT_FALSE(analyze("motor", Level_OK));
+  EXPECT_TRUE(analyze("fan", Level_Warn));
+
+  // Not published yet, still above the published level
+  EXPECT_TRUE(analyze("fan", Level_Warn));
+
+  aggregator_.publishData();
+  EXPECT_FALSE(analyze("fan", Level_Warn));
+  EXPECT_TRUE(analyze("fan", Level_Error));
+  EXPECT_TRUE(analyze("motor", Level_Warn));
+
+  // Back to OK and up again to at most the published level
+  aggregator_.publishData();
+  EXPECT_FALSE(analyze("fan", Level_OK));
+  EXPECT_FALSE(analyze("fan", Level_Warn));
+  EXPECT_FALSE(analyze("motor", Level_Warn));
+
+  aggregator_.publishData();
+  EXPECT_TRUE(analyze("fan", Level_Error));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "fast_escalation_test");
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,168 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <diagnostic_aggregator/item_history.h>
+#include <ros/ros.h>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <gtest/gtest.h>
+
+using namespace std;
+using namespace diagnostic_aggregator;
+
+TEST(HistoryMessages, sharedMessages)
+{
+  HistoryMessages messages;
+  size_t ok = messages.add("OK");
+  size_t ok_again = messages.add("OK");
+  size_t error = messages.add("Error");
+
+  EXPECT_EQ(ok, ok_again);
+  EXPECT_NE(ok, error);
+  EXPECT_EQ(2u, messages.size());
+  EXPECT_EQ("OK", messages.get(ok));
+  EXPECT_EQ("Error", messages.get(error));
+
+  messages.release(ok);
+  EXPECT_EQ("OK", messages.get(ok));
+  messages.release(ok);
+  EXPECT_EQ("", messages.get(ok));
+  EXPECT_EQ(1u, messages.size());
+
+  messages.release(error);
+  EXPECT_EQ(0u, messages.size());
+}
+
+// The oldest entries are dropped, and their messages released
+TEST(ItemHistory, wraparound)
+{
+  boost::shared_ptr<HistoryMessages> messages(new HistoryMessages());
+  ItemHistory history(3, messages);
+
+  history.add(ros::Time(1, 0), 0, "OK");
+  history.add(ros::Time(2, 0), 0, "OK"); // Same as the last one, not recorded
+  history.add(ros::Time(3, 0), 2, "Error 1");
+  history.add(ros::Time(4, 0), 2, "Error 2");
+  EXPECT_EQ(3u, history.size());
+  EXPECT_EQ(3u, messages->size());
+
+  history.add(ros::Time(5, 0), 0, "OK");
+  history.add(ros::Time(6, 0), 1, "Warning");
+  EXPECT_EQ(3u, history.size());
+
+  vector<ros::Time> stamps;
+  vector<int8_t> levels;
+  vector<string> texts;
+  history.get(stamps, levels, texts);
+  ASSERT_EQ(3u, stamps.size());
+  EXPECT_EQ(ros::Time(4, 0), stamps[0]);
+  EXPECT_EQ(ros::Time(5, 0), stamps[1]);
+  EXPECT_EQ(ros::Time(6, 0), stamps[2]);
+  EXPECT_EQ(2, levels[0]);
+  EXPECT_EQ(0, levels[1]);
+  EXPECT_EQ(1, levels[2]);
+  EXPECT_EQ("Error 2", texts[0]);
+  EXPECT_EQ("OK", texts[1]);
+  EXPECT_EQ("Warning", texts[2]);
+
+  // "Error 1" was only used by a dropped entry
+  EXPECT_EQ(3u, messages->size());
+}
+
+// Histories sharing a table keep messages alive until the last one goes
+TEST(ItemHistory, releaseOnDestruction)
+{
+  boost::shared_ptr<HistoryMessages> messages(new HistoryMessages());
+  {
+    ItemHistory first(2, messages);
+    {
+      ItemHistory second(2, messages);
+      first.add(ros::Time(1, 0), 0, "OK");
+      second.add(ros::Time(1, 0), 0, "OK");
+      second.add(ros::Time(2, 0), 2, "Error");
+      EXPECT_EQ(2u, messages->size());
+    }
+
+    EXPECT_EQ(1u, messages->size());
+
+    vector<ros::Time> stamps;
+    vector<int8_t> levels;
+    vector<string> texts;
+    first.get(stamps, levels, texts);
+    ASSERT_EQ(1u, texts.size());
+    EXPECT_EQ("OK", texts[0]);
+  }
+
+  EXPECT_EQ(0u, messages->size());
+}
+
+/*!
+ *\brief Adds the same messages to short-lived histories, like items dropped by other threads
+ */
+static void churnHistories(boost::shared_ptr<HistoryMessages> messages)
+{
+  for (int i = 0; i < 2000; ++i)
+  {
+    ItemHistory history(4, messages);
+    history.add(ros::Time(1, 0), 0, "OK");
+    history.add(ros::Time(2, 0), 2, "Error");
+    history.add(ros::Time(3, 0), 1, i % 2 ? "Warning" : "Slow");
+  }
+}
+
+// Histories sharing a table can be updated and destroyed from several threads
+TEST(ItemHistory, threads)
+{
+  boost::shared_ptr<HistoryMessages> messages(new HistoryMessages());
+  ItemHistory kept(2, messages);
+  kept.add(ros::Time(1, 0), 0, "OK");
+
+  boost::thread_group threads;
+  for (int i = 0; i < 4; ++i)
+    threads.create_thread(boost::bind(&churnHistories, messages));
+  threads.join_all();
+
+  EXPECT_EQ(1u, messages->size());
+  EXPECT_EQ(1u, kept.size());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "item_history_test");
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,142 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <diagnostic_aggregator/aggregator.h>
+#include <ros/ros.h>
+#include <string>
+#include <gtest/gtest.h>
+#include "test_helpers.h"
+
+using namespace std;
+using namespace diagnostic_aggregator;
+
+namespace diagnostic_aggregator {
+
+/*!
+ *\brief Analyzes statuses in a chosen order, as the lanes of a shard would
+ */
+class AggregatorTest : public testing::Test
+{
+protected:
+  /*!
+   *\brief Analyzes a message with one status, received as the seq'th message
+   */
+  void analyze(const string &name, int8_t level, uint64_t seq, bool urgent)
+  {
+    diagnostic_msgs::DiagnosticArray::Ptr msg(new diagnostic_msgs::DiagnosticArray);
+    msg->status.push_back(makeStatus(name, level));
+
+    Aggregator::ShardWork work;
+    work.msg = msg;
+    work.indices.push_back(0);
+    work.publisher = "/publisher";
+    work.seq = seq;
+    work.urgent = urgent;
+
+    Aggregator::Shard &shard = *aggregator_.shards_[0];
+    boost::mutex::scoped_lock lock(shard.mutex);
+    aggregator_.analyzeStatuses(shard, work, NULL);
+  }
+
+  /*!
+   *\brief Level of the item with that name, -1 if there is none
+   */
+  int itemLevel(const string &name)
+  {
+    Aggregator::Shard &shard = *aggregator_.shards_[0];
+    boost::mutex::scoped_lock lock(shard.mutex);
+    map<string, boost::shared_ptr<StatusItem> >::const_iterator it = shard.items.find(name);
+    return it == shard.items.end() ? -1 : it->second->getLevel();
+  }
+
+  /*!
+   *\brief Level diagCallback() compares incoming statuses with, -1 if there is none
+   */
+  int callbackLevel(const string &name)
+  {
+    Aggregator::Shard &shard = *aggregator_.shards_[0];
+    boost::mutex::scoped_lock lock(shard.levels_mutex);
+    map<string, int8_t>::const_iterator it = shard.levels.find(name);
+    return it == shard.levels.end() ? -1 : it->second;
+  }
+
+  Aggregator aggregator_;
+};
+
+}
+
+// Urgent work is analyzed before older bulk work of the same name, which must not undo it
+TEST_F(AggregatorTest, urgentNotUndone)
+{
+  analyze("motor", Level_OK, 0, false);
+  EXPECT_EQ(Level_OK, itemLevel("motor"));
+  EXPECT_EQ(Level_OK, callbackLevel("motor"));
+
+  // Bulk work 1 is still queued when urgent work 2 arrives, and is served after it
+  analyze("motor", Level_Error, 2, true);
+  analyze("motor", Level_OK, 1, false);
+  EXPECT_EQ(Level_Error, itemLevel("motor"));
+  EXPECT_EQ(Level_Error, callbackLevel("motor"));
+}
+
+// Bulk work received after urgent work of the same name still applies
+TEST_F(AggregatorTest, laterBulkApplied)
+{
+  analyze("motor", Level_Error, 0, true);
+  analyze("motor", Level_OK, 1, false);
+  EXPECT_EQ(Level_OK, itemLevel("motor"));
+  EXPECT_EQ(Level_OK, callbackLevel("motor"));
+
+  // Interleaved, the state received last wins
+  analyze("motor", Level_Warn, 3, true);
+  analyze("motor", Level_Error, 5, true);
+  analyze("motor", Level_OK, 2, false);
+  analyze("motor", Level_OK, 4, false);
+  EXPECT_EQ(Level_Error, itemLevel("motor"));
+  analyze("motor", Level_OK, 6, false);
+  EXPECT_EQ(Level_OK, itemLevel("motor"));
+  EXPECT_EQ(Level_OK, callbackLevel("motor"));
+
+  // Other names are not held back
+  analyze("fan", Level_OK, 3, false);
+  EXPECT_EQ(Level_OK, itemLevel("fan"));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "priority_lanes_test");
+
+  return RUN_ALL_TESTS();
+}
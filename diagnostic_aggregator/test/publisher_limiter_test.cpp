@@ -0,0 +1,182 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <diagnostic_aggregator/aggregator.h>
+#include <diagnostic_aggregator/publisher_limiter.h>
+#include <ros/ros.h>
+#include <string>
+#include <gtest/gtest.h>
+#include "test_helpers.h"
+
+using namespace std;
+using namespace diagnostic_aggregator;
+
+// A publisher may send a burst, then is limited to the rate
+TEST(PublisherLimiter, tokenBucket)
+{
+  PublisherLimiter limiter(20, 3);
+  EXPECT_TRUE(limiter.allow("/fast", 2));
+  EXPECT_TRUE(limiter.allow("/fast", 2));
+  EXPECT_TRUE(limiter.allow("/fast", 2));
+  EXPECT_FALSE(limiter.allow("/fast", 2));
+
+  // Other publishers have their own bucket
+  EXPECT_TRUE(limiter.allow("/slow", 1));
+
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> status = limiter.report("/Publishers");
+  EXPECT_EQ(Level_Warn, status->level);
+  EXPECT_EQ("dropped 2 of 8 statuses", findValue(*status, "/fast"));
+  EXPECT_EQ("", findValue(*status, "/slow"));
+
+  // Refills at 20 tokens per second
+  ros::WallDuration(0.1).sleep();
+  EXPECT_TRUE(limiter.allow("/fast", 2));
+
+  // No drops since the last report
+  status = limiter.report("/Publishers");
+  EXPECT_EQ(Level_OK, status->level);
+  EXPECT_EQ("dropped 2 of 10 statuses", findValue(*status, "/fast"));
+}
+
+// Parts of a message dropped from a full queue count their own statuses
+TEST(PublisherLimiter, partialDrops)
+{
+  PublisherLimiter limiter;
+  EXPECT_TRUE(limiter.allow("/node", 10));
+  limiter.countDropped("/node", 4);
+
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> status = limiter.report("/Publishers");
+  EXPECT_EQ(Level_Warn, status->level);
+  EXPECT_EQ("dropped 4 of 10 statuses", findValue(*status, "/node"));
+}
+
+// Idle publishers are forgotten, once their bucket is full again
+TEST(PublisherLimiter, idlePublishers)
+{
+  PublisherLimiter limiter(100, 1, 0.05);
+  EXPECT_TRUE(limiter.allow("/gone", 1));
+  EXPECT_FALSE(limiter.allow("/gone", 1));
+
+  ros::WallDuration(0.1).sleep();
+  EXPECT_TRUE(limiter.allow("/active", 1));
+
+  // The drop of the forgotten publisher still warns once
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> status = limiter.report("/Publishers");
+  EXPECT_EQ(Level_Warn, status->level);
+  EXPECT_EQ(0u, status->values.size());
+
+  status = limiter.report("/Publishers");
+  EXPECT_EQ(Level_OK, status->level);
+
+  // Comes back with a full bucket
+  EXPECT_TRUE(limiter.allow("/gone", 1));
+}
+
+namespace diagnostic_aggregator {
+
+/*!
+ *\brief Reaches the shard work queue of the Aggregator
+ */
+class AggregatorTest : public testing::Test
+{
+protected:
+  typedef Aggregator::WorkQueue WorkQueue;
+  typedef Aggregator::ShardWork ShardWork;
+
+  static void push(WorkQueue &queue, const string &publisher, uint64_t seq, unsigned int statuses = 1)
+  {
+    ShardWork work;
+    work.publisher = publisher;
+    work.seq = seq;
+    work.indices.resize(statuses);
+    queue.push(work);
+  }
+};
+
+}
+
+// Publishers are served one message each in turn, in the order they queued
+TEST_F(AggregatorTest, fairQueue)
+{
+  WorkQueue queue;
+  push(queue, "/flood", 0);
+  push(queue, "/flood", 1);
+  push(queue, "/flood", 2);
+  push(queue, "/quiet", 3);
+  push(queue, "/other", 4);
+  push(queue, "/quiet", 5);
+  EXPECT_EQ(6u, queue.size);
+
+  const uint64_t expected[] = { 0, 3, 4, 1, 5, 2 };
+  for (unsigned int i = 0; i < 6; ++i)
+    EXPECT_EQ(expected[i], queue.pop().seq);
+  EXPECT_EQ(0u, queue.size);
+  EXPECT_TRUE(queue.ready.empty());
+  EXPECT_TRUE(queue.queues.empty());
+}
+
+// The oldest work of the publisher with the most queued is dropped
+TEST_F(AggregatorTest, dropOldest)
+{
+  WorkQueue queue;
+  push(queue, "/quiet", 0);
+  push(queue, "/flood", 1, 3);
+  push(queue, "/flood", 2);
+  push(queue, "/flood", 3);
+
+  ShardWork dropped = queue.dropOldest();
+  EXPECT_EQ("/flood", dropped.publisher);
+  EXPECT_EQ(1u, dropped.seq);
+  EXPECT_EQ(3u, dropped.indices.size());
+  EXPECT_EQ(3u, queue.size);
+
+  dropped = queue.dropOldest();
+  EXPECT_EQ(2u, dropped.seq);
+
+  // With one each, the first by name loses its work and leaves the turns
+  dropped = queue.dropOldest();
+  EXPECT_EQ("/flood", dropped.publisher);
+  EXPECT_EQ(3u, dropped.seq);
+  EXPECT_EQ(1u, queue.ready.size());
+  EXPECT_EQ(0u, queue.pop().seq);
+  EXPECT_EQ(0u, queue.size);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "publisher_limiter_test");
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,116 @@
+#!/usr/bin/env python
+# Software License Agreement (BSD License)
+#
+# Copyright (c) 2009, Willow Garage, Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above
+#    copyright notice, this list of conditions and the following
+#    disclaimer in the documentation and/or other materials provided
+#    with the distribution.
+#  * Neither the name of the Willow Garage nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+# FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+# COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+# INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+# ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+##\brief Tests that reloading one analyzer keeps the items of the others
+
+from __future__ import with_statement
+PKG = 'diagnostic_aggregator'
+import roslib; roslib.load_manifest(PKG)
+import rospy, rostest, unittest
+from diagnostic_msgs.msg import DiagnosticArray, DiagnosticStatus
+from diagnostic_aggregator.srv import ReloadAnalyzers
+import sys
+import threading
+
+class TestReload(unittest.TestCase):
+    def __init__(self, *args):
+        super(TestReload, self).__init__(*args)
+
+        self._mutex = threading.Lock()
+        self._agg = {}
+
+        rospy.init_node('test_reload')
+        rospy.Subscriber('/diagnostics_agg', DiagnosticArray, self.agg_cb)
+        self._pub = rospy.Publisher('/diagnostics', DiagnosticArray, queue_size=1)
+
+    def agg_cb(self, msg):
+        with self._mutex:
+            for stat in msg.status:
+                self._agg[stat.name] = stat
+
+    def wait_for_agg(self):
+        """Waits for the output of a publish that started after this call"""
+        with self._mutex:
+            self._agg = {}
+        rospy.sleep(rospy.Duration(2))
+        with self._mutex:
+            self._agg = {}
+        while not rospy.is_shutdown():
+            rospy.sleep(rospy.Duration(0.5))
+            with self._mutex:
+                if self._agg:
+                    return dict(self._agg)
+
+    def reload(self):
+        rospy.wait_for_service('/diagnostics_agg/reload', timeout=10)
+        return rospy.ServiceProxy('/diagnostics_agg/reload', ReloadAnalyzers)()
+
+    def test_reload(self):
+        # Published until the aggregator has them, then never again
+        arr = DiagnosticArray()
+        arr.status = [
+            DiagnosticStatus(name='primary', message='hello-primary'),
+            DiagnosticStatus(name='secondary', message='hello-secondary')
+        ]
+        while not rospy.is_shutdown():
+            arr.header.stamp = rospy.get_rostime()
+            self._pub.publish(arr)
+            rospy.sleep(rospy.Duration(1))
+            with self._mutex:
+                if '/Secondary/secondary' in self._agg and '/Primary/primary' in self._agg:
+                    break
+
+        rospy.set_param('/diag_agg/analyzers/primary/path', 'Renamed')
+        resp = self.reload()
+        self.assert_(resp.success, 'Reload failed: %s' % resp.message)
+        self.assert_(resp.reloaded == 1, 'Expected 1 analyzer reloaded, got %d' % resp.reloaded)
+        self.assert_(resp.reused == 1, 'Expected 1 analyzer kept, got %d' % resp.reused)
+
+        agg = self.wait_for_agg()
+        self.assert_('/Secondary/secondary' in agg, 'Kept analyzer lost its item. Items: %s' % agg.keys())
+        self.assert_(agg['/Secondary/secondary'].message == 'hello-secondary')
+        self.assert_('/Renamed/primary' in agg, 'Reloaded analyzer didn\'t get its item. Items: %s' % agg.keys())
+        self.assert_(agg['/Renamed/primary'].message == 'hello-primary')
+        self.assert_('/Primary' not in agg, 'Old analyzer still reported')
+
+        # A failed reload keeps all the current analyzers
+        rospy.set_param('/diag_agg/analyzers/primary/type', 'diagnostic_aggregator/NoSuchAnalyzer')
+        resp = self.reload()
+        self.assert_(not resp.success, 'Reload with an unknown analyzer type succeeded')
+
+        agg = self.wait_for_agg()
+        self.assert_('/Renamed/primary' in agg, 'Analyzer lost after failed reload. Items: %s' % agg.keys())
+        self.assert_('/Secondary/secondary' in agg, 'Analyzer lost after failed reload. Items: %s' % agg.keys())
+
+if __name__ == '__main__':
+    rostest.run(PKG, sys.argv[0], TestReload, sys.argv)
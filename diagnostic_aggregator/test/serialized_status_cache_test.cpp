@@ -0,0 +1,155 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <diagnostic_aggregator/serialized_status_cache.h>
+#include <ros/ros.h>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "test_helpers.h"
+
+using namespace std;
+using namespace diagnostic_aggregator;
+
+template<typename M>
+static vector<uint8_t> serialize(const M &msg)
+{
+  vector<uint8_t> bytes(ros::serialization::serializationLength(msg));
+  ros::serialization::OStream stream(bytes.empty() ? NULL : &bytes[0], bytes.size());
+  ros::serialization::serialize(stream, msg);
+  return bytes;
+}
+
+/*!
+ *\brief Checks the cached array serializes to the same bytes as a plain DiagnosticArray
+ */
+static void expectSameBytes(SerializedStatusCache &cache, const Report &statuses)
+{
+  diagnostic_msgs::DiagnosticArray plain;
+  plain.header.seq = 7;
+  plain.header.stamp = ros::Time(100, 5);
+  plain.header.frame_id = "base";
+  for (unsigned int i = 0; i < statuses.size(); ++i)
+    plain.status.push_back(*statuses[i]);
+
+  CachedDiagnosticArray cached;
+  cache.build(plain.header, statuses, cached);
+
+  vector<uint8_t> expected = serialize(plain);
+  ASSERT_FALSE(expected.empty());
+  EXPECT_TRUE(serialize(cached) == expected);
+}
+
+static Report itemStatuses(const vector<boost::shared_ptr<StatusItem> > &items, bool stale = false)
+{
+  Report statuses;
+  diagnostic_msgs::DiagnosticStatus header = makeStatus("/Robot", Level_OK);
+  statuses.push_back(boost::shared_ptr<diagnostic_msgs::DiagnosticStatus>(
+                       new diagnostic_msgs::DiagnosticStatus(header)));
+  for (unsigned int i = 0; i < items.size(); ++i)
+    statuses.push_back(items[i]->toStatusMsg("/Robot", stale));
+  return statuses;
+}
+
+// Reused bytes are the same as serializing again
+TEST(SerializedStatusCache, sameBytes)
+{
+  vector<boost::shared_ptr<StatusItem> > items;
+  items.push_back(makeItem("motor", Level_OK, "Temperature", "40", "Current", "2.5"));
+  items.push_back(makeItem("fan", Level_Warn, "Speed", "100"));
+
+  SerializedStatusCache cache;
+  expectSameBytes(cache, itemStatuses(items));
+  EXPECT_EQ(3u, cache.getEncoded());
+  EXPECT_EQ(0u, cache.getReused());
+
+  expectSameBytes(cache, itemStatuses(items));
+  EXPECT_EQ(4u, cache.getEncoded());
+  EXPECT_EQ(2u, cache.getReused());
+
+  // A new version of an item is encoded again
+  diagnostic_msgs::DiagnosticStatus hot = makeStatus("motor", Level_Error, "Temperature", "95", "Current", "2.5");
+  items[0]->update(&hot);
+  expectSameBytes(cache, itemStatuses(items));
+  EXPECT_EQ(6u, cache.getEncoded());
+  EXPECT_EQ(3u, cache.getReused());
+
+  // So is an item that went stale
+  expectSameBytes(cache, itemStatuses(items, true));
+  EXPECT_EQ(9u, cache.getEncoded());
+}
+
+// A level reported instead of the item's, with the item version unchanged, is encoded again
+TEST(SerializedStatusCache, levelChangeWithinVersion)
+{
+  boost::shared_ptr<StatusItem> item = makeItem("motor", Level_OK, "Temperature", "85");
+
+  SerializedStatusCache cache;
+  Report statuses;
+  statuses.push_back(item->toStatusMsg("/Robot", false));
+  expectSameBytes(cache, statuses);
+
+  statuses[0] = item->toStatusMsg("/Robot", false, Level_Error, "Temperature 85 above 80");
+  expectSameBytes(cache, statuses);
+  EXPECT_EQ(2u, cache.getEncoded());
+
+  statuses[0] = item->toStatusMsg("/Robot", false, Level_Warn, "Temperature 85 above 80");
+  expectSameBytes(cache, statuses);
+  EXPECT_EQ(3u, cache.getEncoded());
+
+  statuses[0] = item->toStatusMsg("/Robot", false);
+  expectSameBytes(cache, statuses);
+  EXPECT_EQ(4u, cache.getEncoded());
+  EXPECT_EQ(0u, cache.getReused());
+}
+
+// Statuses with the same name are each kept in the array
+TEST(SerializedStatusCache, duplicateNames)
+{
+  Report statuses;
+  statuses.push_back(makeItem("motor", Level_OK)->toStatusMsg("/Robot", false));
+  statuses.push_back(makeItem("motor", Level_Error)->toStatusMsg("/Robot", false));
+
+  SerializedStatusCache cache;
+  expectSameBytes(cache, statuses);
+  expectSameBytes(cache, statuses);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "serialized_status_cache_test");
+
+  return RUN_ALL_TESTS();
+}
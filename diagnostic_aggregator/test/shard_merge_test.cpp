@@ -0,0 +1,187 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <diagnostic_aggregator/aggregator.h>
+#include <diagnostic_aggregator/analyzer_group.h>
+#include <ros/ros.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "test_helpers.h"
+
+using namespace std;
+using namespace diagnostic_aggregator;
+
+static const char *EXPECTED[] = { "expected1", "expected2", "expected3", "expected4" };
+static const unsigned int NUM_EXPECTED = 4;
+
+namespace diagnostic_aggregator {
+
+/*!
+ *\brief Reports statuses from two shards, and merges them like the aggregator
+ */
+class AggregatorTest : public testing::Test
+{
+protected:
+  /*!
+   *\brief Analyzes OK statuses with these names, alternating shards
+   *
+   *\param ns : Namespace of the analyzer parameters
+   */
+  void reportShards(const vector<string> &names, const string &ns = "~")
+  {
+    ros::NodeHandle nh = ros::NodeHandle(ns);
+
+    AnalyzerGroup shards[2];
+    EXPECT_TRUE(shards[0].init("/Robot", nh));
+    EXPECT_TRUE(shards[1].init("/Robot", nh));
+
+    for (unsigned int i = 0; i < names.size(); ++i)
+    {
+      diagnostic_msgs::DiagnosticStatus status;
+      status.name = names[i];
+      status.level = diagnostic_msgs::DiagnosticStatus::OK;
+      status.message = "Running";
+      boost::shared_ptr<StatusItem> item(new StatusItem(&status));
+
+      AnalyzerGroup &shard = shards[i % 2];
+      EXPECT_TRUE(shard.match(status.name));
+      EXPECT_TRUE(shard.analyze(item));
+    }
+
+    reports_.clear();
+    reports_.push_back(shards[0].report());
+    reports_.push_back(shards[1].report());
+
+    expected_items_.clear();
+    shards[0].getExpectedItems(expected_items_);
+  }
+
+  /*!
+   *\brief Reports the first count expected names
+   */
+  void reportExpected(unsigned int count)
+  {
+    reportShards(vector<string>(EXPECTED, EXPECTED + count));
+  }
+
+  Report merge() const
+  {
+    return Aggregator::mergeShardReports(reports_, expected_items_);
+  }
+
+  vector<Report> reports_;
+  map<string, int> expected_items_;
+};
+
+}
+
+// Each shard has half the expected items and reports the other half missing
+TEST_F(AggregatorTest, expectedSplitAcrossShards)
+{
+  reportExpected(NUM_EXPECTED);
+
+  // Without merging, each shard sees missing items
+  EXPECT_EQ(Level_Error, reportedLevel(reports_[0], "/Robot/Split"));
+  EXPECT_EQ(Level_Error, reportedLevel(reports_[1], "/Robot/Split"));
+
+  Report merged = merge();
+
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> header = findStatus(merged, "/Robot/Split");
+  ASSERT_TRUE(header);
+  EXPECT_EQ(Level_OK, header->level);
+  EXPECT_EQ("OK", header->message);
+  for (unsigned int i = 0; i < NUM_EXPECTED; ++i)
+  {
+    EXPECT_EQ(Level_OK, reportedLevel(merged, string("/Robot/Split/") + EXPECTED[i]));
+    EXPECT_EQ("Running", findValue(*header, EXPECTED[i]));
+  }
+
+  EXPECT_EQ(Level_OK, reportedLevel(merged, "/Robot"));
+}
+
+// An item missing from every shard is still an error once merged
+TEST_F(AggregatorTest, expectedMissingFromAllShards)
+{
+  reportExpected(NUM_EXPECTED - 1);
+  Report merged = merge();
+
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> header = findStatus(merged, "/Robot/Split");
+  ASSERT_TRUE(header);
+  EXPECT_EQ(Level_Error, header->level);
+  EXPECT_EQ(Level_Stale,
+            reportedLevel(merged, string("/Robot/Split/") + EXPECTED[NUM_EXPECTED - 1]));
+  EXPECT_EQ(Level_OK,
+            reportedLevel(merged, string("/Robot/Split/") + EXPECTED[0]));
+  EXPECT_EQ(Level_Error, reportedLevel(merged, "/Robot"));
+}
+
+// num_items is checked against the items of all shards
+TEST_F(AggregatorTest, numItemsAcrossShards)
+{
+  vector<string> names;
+  names.push_back("counted1");
+  names.push_back("counted2");
+  reportShards(names, "~num_items");
+
+  // Each shard has one of the two items
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> copy = findStatus(reports_[0], "/Robot/Counted");
+  ASSERT_TRUE(copy);
+  EXPECT_EQ(Level_Error, copy->level);
+  EXPECT_EQ("Expected 2, found 1", copy->message);
+
+  Report merged = merge();
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> header = findStatus(merged, "/Robot/Counted");
+  ASSERT_TRUE(header);
+  EXPECT_EQ(Level_OK, header->level);
+  EXPECT_EQ("OK", header->message);
+
+  // One too many, though no shard has more than two
+  names.push_back("counted3");
+  reportShards(names, "~num_items");
+  merged = merge();
+  header = findStatus(merged, "/Robot/Counted");
+  ASSERT_TRUE(header);
+  EXPECT_EQ(Level_Error, header->level);
+  EXPECT_EQ("Expected 2, found 3", header->message);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "shard_merge_test");
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,200 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <diagnostic_aggregator/snapshot.h>
+#include <ros/ros.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "test_helpers.h"
+
+using namespace std;
+using namespace diagnostic_aggregator;
+
+/*!
+ *\brief Snapshot file in a directory of its own, removed after each test
+ */
+class SnapshotTest : public testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    char dir[] = "/tmp/diagnostic_snapshot_XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    dir_ = dir;
+    path_ = dir_ + "/snapshot";
+
+    ros::Time::setNow(ros::Time(1000, 0));
+    SnapshotItem motor;
+    motor.item = makeItem("motor", Level_Warn, "Temperature", "70", "Current", "2.5");
+    motor.matches.push_back(true);
+    motor.matches.push_back(false);
+    items_.push_back(motor);
+
+    ros::Time::setNow(ros::Time(1005, 500));
+    SnapshotItem fan;
+    fan.item = makeItem("fan", Level_OK);
+    items_.push_back(fan);
+  }
+
+  virtual void TearDown()
+  {
+    unlink(path_.c_str());
+    rmdir(dir_.c_str());
+  }
+
+  /*!
+   *\brief Contents of the snapshot file
+   */
+  string readFile() const
+  {
+    ifstream in(path_.c_str(), ios::binary);
+    return string((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+  }
+
+  void writeFile(const string &contents) const
+  {
+    ofstream out(path_.c_str(), ios::binary | ios::trunc);
+    out << contents;
+  }
+
+  string dir_, path_;
+  vector<SnapshotItem> items_;
+};
+
+// Items come back with their statuses, update times and matches
+TEST_F(SnapshotTest, roundTrip)
+{
+  ASSERT_TRUE(writeSnapshot(path_, 42, items_));
+  EXPECT_EQ(0, access(path_.c_str(), F_OK));
+  EXPECT_NE(0, access((path_ + ".tmp").c_str(), F_OK));
+
+  vector<SnapshotItem> items;
+  ASSERT_TRUE(readSnapshot(path_, 42, items));
+  ASSERT_EQ(2u, items.size());
+
+  const StatusItem &motor = *items[0].item;
+  EXPECT_EQ("motor", motor.getName());
+  EXPECT_EQ(Level_Warn, motor.getLevel());
+  EXPECT_EQ("Warning", motor.getMessage());
+  EXPECT_EQ("70", motor.getValue("Temperature"));
+  EXPECT_EQ("2.5", motor.getValue("Current"));
+  EXPECT_EQ(ros::Time(1000, 0), motor.getLastUpdateTime());
+  ASSERT_EQ(2u, items[0].matches.size());
+  EXPECT_TRUE(items[0].matches[0]);
+  EXPECT_FALSE(items[0].matches[1]);
+
+  EXPECT_EQ("fan", items[1].item->getName());
+  EXPECT_EQ(ros::Time(1005, 500), items[1].item->getLastUpdateTime());
+  EXPECT_TRUE(items[1].matches.empty());
+}
+
+// Matches of another analyzer configuration are dropped, the items are kept
+TEST_F(SnapshotTest, configHashMismatch)
+{
+  ASSERT_TRUE(writeSnapshot(path_, 42, items_));
+
+  vector<SnapshotItem> items;
+  ASSERT_TRUE(readSnapshot(path_, 43, items));
+  ASSERT_EQ(2u, items.size());
+  EXPECT_EQ("motor", items[0].item->getName());
+  EXPECT_TRUE(items[0].matches.empty());
+
+  EXPECT_NE(snapshotConfigHash("analyzers a"), snapshotConfigHash("analyzers b"));
+  EXPECT_EQ(snapshotConfigHash("analyzers a"), snapshotConfigHash("analyzers a"));
+}
+
+// A snapshot cut anywhere is ignored as a whole
+TEST_F(SnapshotTest, truncated)
+{
+  ASSERT_TRUE(writeSnapshot(path_, 42, items_));
+  string contents = readFile();
+
+  for (size_t size = 0; size < contents.size(); size += 3)
+  {
+    writeFile(contents.substr(0, size));
+    vector<SnapshotItem> items;
+    EXPECT_FALSE(readSnapshot(path_, 42, items)) << "Truncated to " << size << " bytes";
+    EXPECT_TRUE(items.empty());
+  }
+
+  vector<SnapshotItem> items;
+  EXPECT_FALSE(readSnapshot(dir_ + "/missing", 42, items));
+}
+
+// Files that aren't snapshots, or have a bad length, are ignored
+TEST_F(SnapshotTest, corrupted)
+{
+  ASSERT_TRUE(writeSnapshot(path_, 42, items_));
+  string contents = readFile();
+
+  string bad_magic = contents;
+  bad_magic[0] = 'X';
+  writeFile(bad_magic);
+  vector<SnapshotItem> items;
+  EXPECT_FALSE(readSnapshot(path_, 42, items));
+
+  string bad_version = contents;
+  bad_version[4] = 99;
+  writeFile(bad_version);
+  EXPECT_FALSE(readSnapshot(path_, 42, items));
+
+  // Match count of the first item, past the end of the file
+  string bad_count = contents;
+  bad_count[28] = (char)0xff;
+  bad_count[29] = (char)0xff;
+  writeFile(bad_count);
+  EXPECT_FALSE(readSnapshot(path_, 42, items));
+  EXPECT_TRUE(items.empty());
+
+  // Status length of the first item, longer than what's left
+  string bad_length = contents;
+  bad_length[34] = (char)0xff;
+  bad_length[35] = (char)0xff;
+  writeFile(bad_length);
+  EXPECT_FALSE(readSnapshot(path_, 42, items));
+  EXPECT_TRUE(items.empty());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "snapshot_test");
+
+  return RUN_ALL_TESTS();
+}
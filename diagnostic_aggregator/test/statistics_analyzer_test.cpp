@@ -0,0 +1,153 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <diagnostic_aggregator/statistics_analyzer.h>
+#include <ros/ros.h>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "test_helpers.h"
+
+using namespace std;
+using namespace diagnostic_aggregator;
+
+TEST(StatisticsAnalyzer, statistics)
+{
+  StatisticsAnalyzer analyzer;
+  ASSERT_TRUE(analyzer.init("/Robot", ros::NodeHandle("~motors")));
+  ros::Time::setNow(ros::Time(1000, 0));
+
+  analyzer.analyze(makeItem("Motor 1", Level_OK, "Temperature", "20", "Current", "1.5"));
+  analyzer.analyze(makeItem("Motor 2", Level_Warn, "Temperature", "40 C", "Current", "2.5"));
+  analyzer.analyze(makeItem("Motor 3", Level_OK, "Temperature", "hot"));
+  analyzer.analyze(makeItem("Motor 4", Level_Error, "Temperature", "60"));
+
+  Report report = analyzer.report();
+  ASSERT_TRUE(findStatus(report, "/Robot/Motors"));
+  const diagnostic_msgs::DiagnosticStatus &header = *findStatus(report, "/Robot/Motors");
+
+  EXPECT_EQ("3", findValue(header, "Temperature count"));
+  EXPECT_EQ("20", findValue(header, "Temperature min"));
+  EXPECT_EQ("60", findValue(header, "Temperature max"));
+  EXPECT_EQ("40", findValue(header, "Temperature mean"));
+  EXPECT_EQ("2", findValue(header, "Current count"));
+  EXPECT_EQ("1.5", findValue(header, "Current min"));
+  EXPECT_EQ("2.5", findValue(header, "Current max"));
+  EXPECT_EQ("2", findValue(header, "Current mean"));
+  EXPECT_EQ("2", findValue(header, "Items OK"));
+  EXPECT_EQ("1", findValue(header, "Items warning"));
+  EXPECT_EQ("1", findValue(header, "Items error"));
+  EXPECT_EQ("0", findValue(header, "Items stale"));
+}
+
+// Items are updated in place by name
+TEST(StatisticsAnalyzer, updatedItem)
+{
+  StatisticsAnalyzer analyzer;
+  ASSERT_TRUE(analyzer.init("/Robot", ros::NodeHandle("~motors")));
+  ros::Time::setNow(ros::Time(1000, 0));
+
+  analyzer.analyze(makeItem("Motor 1", Level_OK, "Temperature", "20"));
+  analyzer.analyze(makeItem("Motor 2", Level_OK, "Temperature", "30"));
+  analyzer.analyze(makeItem("Motor 1", Level_OK, "Temperature", "50"));
+
+  Report report = analyzer.report();
+  ASSERT_TRUE(findStatus(report, "/Robot/Motors"));
+  const diagnostic_msgs::DiagnosticStatus &header = *findStatus(report, "/Robot/Motors");
+  EXPECT_EQ("2", findValue(header, "Temperature count"));
+  EXPECT_EQ("30", findValue(header, "Temperature min"));
+  EXPECT_EQ("50", findValue(header, "Temperature max"));
+  EXPECT_EQ("0", findValue(header, "Current count"));
+  EXPECT_EQ("", findValue(header, "Current min"));
+}
+
+// Stale items are left out of the statistics, and counted as stale
+TEST(StatisticsAnalyzer, staleItems)
+{
+  StatisticsAnalyzer analyzer;
+  ASSERT_TRUE(analyzer.init("/Robot", ros::NodeHandle("~motors")));
+
+  ros::Time::setNow(ros::Time(1000, 0));
+  analyzer.analyze(makeItem("Motor 1", Level_OK, "Temperature", "20"));
+  ros::Time::setNow(ros::Time(1010, 0));
+  analyzer.analyze(makeItem("Motor 2", Level_OK, "Temperature", "40"));
+
+  Report report = analyzer.report();
+  ASSERT_TRUE(findStatus(report, "/Robot/Motors"));
+  const diagnostic_msgs::DiagnosticStatus &header = *findStatus(report, "/Robot/Motors");
+  EXPECT_EQ("1", findValue(header, "Temperature count"));
+  EXPECT_EQ("40", findValue(header, "Temperature mean"));
+  EXPECT_EQ("1", findValue(header, "Items OK"));
+  EXPECT_EQ("1", findValue(header, "Items stale"));
+}
+
+// With discard_stale, stale items are removed from the statistics
+TEST(StatisticsAnalyzer, discardStale)
+{
+  StatisticsAnalyzer analyzer;
+  ASSERT_TRUE(analyzer.init("/Robot", ros::NodeHandle("~discarding")));
+
+  ros::Time::setNow(ros::Time(1000, 0));
+  analyzer.analyze(makeItem("Motor 1", Level_OK, "Temperature", "20"));
+  analyzer.analyze(makeItem("Motor 2", Level_OK, "Temperature", "30"));
+  ros::Time::setNow(ros::Time(1010, 0));
+  analyzer.analyze(makeItem("Motor 3", Level_OK, "Temperature", "40"));
+
+  Report report = analyzer.report();
+  EXPECT_FALSE(findStatus(report, "/Robot/Discarding/Motor 1"));
+  EXPECT_FALSE(findStatus(report, "/Robot/Discarding/Motor 2"));
+  ASSERT_TRUE(findStatus(report, "/Robot/Discarding"));
+  const diagnostic_msgs::DiagnosticStatus &header = *findStatus(report, "/Robot/Discarding");
+  EXPECT_EQ("1", findValue(header, "Temperature count"));
+  EXPECT_EQ("40", findValue(header, "Temperature min"));
+  EXPECT_EQ("1", findValue(header, "Items OK"));
+  EXPECT_EQ("0", findValue(header, "Items stale"));
+
+  // Items that come back are added again
+  analyzer.analyze(makeItem("Motor 1", Level_OK, "Temperature", "10"));
+  report = analyzer.report();
+  ASSERT_TRUE(findStatus(report, "/Robot/Discarding"));
+  const diagnostic_msgs::DiagnosticStatus &again = *findStatus(report, "/Robot/Discarding");
+  EXPECT_EQ("2", findValue(again, "Temperature count"));
+  EXPECT_EQ("10", findValue(again, "Temperature min"));
+  EXPECT_EQ("25", findValue(again, "Temperature mean"));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "statistics_analyzer_test");
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,160 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <diagnostic_aggregator/aggregator.h>
+#include <ros/ros.h>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "test_helpers.h"
+
+using namespace std;
+using namespace diagnostic_aggregator;
+
+namespace diagnostic_aggregator {
+
+/*!
+ *\brief Analyzes messages at a chosen time, and keeps the events they produce
+ */
+class AggregatorTest : public testing::Test
+{
+protected:
+  /*!
+   *\brief Analyzes a message with these statuses at time sec, returns its events
+   */
+  vector<StatusEvent> analyze(double sec, const vector<diagnostic_msgs::DiagnosticStatus> &statuses)
+  {
+    ros::Time::setNow(ros::Time(sec));
+
+    diagnostic_msgs::DiagnosticArray::Ptr msg(new diagnostic_msgs::DiagnosticArray);
+    msg->status = statuses;
+
+    Aggregator::ShardWork work;
+    work.msg = msg;
+    for (unsigned int i = 0; i < statuses.size(); ++i)
+      work.indices.push_back(i);
+    work.publisher = "/publisher";
+
+    StatusEventArray events;
+    Aggregator::Shard &shard = *aggregator_.shards_[0];
+    boost::mutex::scoped_lock lock(shard.mutex);
+    aggregator_.analyzeStatuses(shard, work, &events);
+    return events.events;
+  }
+
+  vector<StatusEvent> analyze(double sec, const diagnostic_msgs::DiagnosticStatus &status)
+  {
+    return analyze(sec, vector<diagnostic_msgs::DiagnosticStatus>(1, status));
+  }
+
+  /*!
+   *\brief Current item with that name, NULL if there is none
+   */
+  boost::shared_ptr<StatusItem> item(const string &name)
+  {
+    Aggregator::Shard &shard = *aggregator_.shards_[0];
+    boost::mutex::scoped_lock lock(shard.mutex);
+    map<string, boost::shared_ptr<StatusItem> >::const_iterator it = shard.items.find(name);
+    return it == shard.items.end() ? boost::shared_ptr<StatusItem>() : it->second;
+  }
+
+  Aggregator aggregator_;
+};
+
+}
+
+// Each level transition is one event, from the item updated in place
+TEST_F(AggregatorTest, levelTransitions)
+{
+  vector<StatusEvent> events = analyze(10.0, makeStatus("motor", Level_OK));
+  ASSERT_EQ(1u, events.size());
+  EXPECT_EQ("motor", events[0].name);
+  EXPECT_EQ(Level_Stale, events[0].previous_level);
+  EXPECT_EQ(Level_OK, events[0].level);
+  EXPECT_EQ(ros::Time(10.0), events[0].stamp);
+
+  boost::shared_ptr<StatusItem> motor = item("motor");
+  ASSERT_TRUE(motor);
+
+  // Same level, no event
+  EXPECT_TRUE(analyze(11.0, makeStatus("motor", Level_OK)).empty());
+
+  diagnostic_msgs::DiagnosticStatus overheated = makeStatus("motor", Level_Error);
+  overheated.message = "Overheated";
+  vector<diagnostic_msgs::DiagnosticStatus> statuses;
+  statuses.push_back(overheated);
+  statuses.push_back(makeStatus("fan", Level_Warn));
+  events = analyze(12.0, statuses);
+  ASSERT_EQ(2u, events.size());
+  EXPECT_EQ("motor", events[0].name);
+  EXPECT_EQ(Level_OK, events[0].previous_level);
+  EXPECT_EQ(Level_Error, events[0].level);
+  EXPECT_EQ("Overheated", events[0].message);
+  EXPECT_EQ(ros::Time(12.0), events[0].stamp);
+  EXPECT_EQ("fan", events[1].name);
+  EXPECT_EQ(Level_Stale, events[1].previous_level);
+  EXPECT_EQ(Level_Warn, events[1].level);
+
+  // The item was updated, not replaced
+  EXPECT_EQ(motor, item("motor"));
+  EXPECT_EQ(Level_Error, motor->getLevel());
+  EXPECT_EQ("Overheated", motor->getMessage());
+  EXPECT_EQ(ros::Time(12.0), motor->getLastUpdateTime());
+}
+
+// Transitions shorter than a publish period each have their event
+TEST_F(AggregatorTest, shortTransitions)
+{
+  analyze(10.0, makeStatus("motor", Level_OK));
+
+  vector<diagnostic_msgs::DiagnosticStatus> statuses;
+  statuses.push_back(makeStatus("motor", Level_Error));
+  statuses.push_back(makeStatus("motor", Level_OK));
+  vector<StatusEvent> events = analyze(10.1, statuses);
+  ASSERT_EQ(2u, events.size());
+  EXPECT_EQ(Level_OK, events[0].previous_level);
+  EXPECT_EQ(Level_Error, events[0].level);
+  EXPECT_EQ(Level_Error, events[1].previous_level);
+  EXPECT_EQ(Level_OK, events[1].level);
+
+  EXPECT_EQ(1u, analyze(10.2, makeStatus("motor", Level_Warn)).size());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "status_events_test");
+
+  return RUN_ALL_TESTS();
+}
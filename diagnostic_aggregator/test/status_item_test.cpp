@@ -0,0 +1,254 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <diagnostic_aggregator/status_item.h>
+#include <ros/ros.h>
+#include <string>
+#include <gtest/gtest.h>
+#include "test_helpers.h"
+
+using namespace std;
+using namespace diagnostic_aggregator;
+
+static bool parse(const string &value, double &number)
+{
+  return makeItem("Parse", Level_OK, "Value", value)->getNumericValue("Value", number);
+}
+
+TEST(StatusItem, numericValues)
+{
+  double number = 0;
+  EXPECT_TRUE(parse("80.5", number));
+  EXPECT_DOUBLE_EQ(80.5, number);
+  EXPECT_TRUE(parse(" -3 ", number));
+  EXPECT_DOUBLE_EQ(-3, number);
+  EXPECT_TRUE(parse("80.5 C", number));
+  EXPECT_DOUBLE_EQ(80.5, number);
+  EXPECT_TRUE(parse(".5", number));
+  EXPECT_DOUBLE_EQ(0.5, number);
+  EXPECT_TRUE(parse("1e3", number));
+  EXPECT_DOUBLE_EQ(1000, number);
+
+  EXPECT_FALSE(parse("", number));
+  EXPECT_FALSE(parse("hot", number));
+  EXPECT_FALSE(parse("80,5", number));
+  EXPECT_FALSE(parse("80C", number));
+  EXPECT_FALSE(parse("inf", number));
+  EXPECT_FALSE(parse("-infinity", number));
+  EXPECT_FALSE(parse("nan", number));
+  EXPECT_FALSE(parse("0x50", number));
+  EXPECT_FALSE(parse("1e999", number));
+  EXPECT_FALSE(parse("1e", number));
+  EXPECT_FALSE(parse(".", number));
+}
+
+TEST(StatusItem, summarizeLevels)
+{
+  int8_t levels[] = { Level_OK, Level_Error, Level_Stale, Level_OK, Level_Warn, Level_OK, 5 };
+  LevelSummary summary = summarizeLevels(levels, 7);
+  EXPECT_EQ(5, summary.max_level);
+  EXPECT_FALSE(summary.all_stale);
+  EXPECT_EQ(3u, summary.counts[Level_OK]);
+  EXPECT_EQ(1u, summary.counts[Level_Warn]);
+  EXPECT_EQ(1u, summary.counts[Level_Error]);
+  EXPECT_EQ(1u, summary.counts[Level_Stale]);
+
+  int8_t stale[] = { Level_Stale, Level_Stale };
+  summary = summarizeLevels(stale, 2);
+  EXPECT_EQ(Level_Stale, summary.max_level);
+  EXPECT_TRUE(summary.all_stale);
+  EXPECT_EQ(2u, summary.counts[Level_Stale]);
+
+  summary = summarizeLevels(NULL, 0);
+  EXPECT_EQ(Level_OK, summary.max_level);
+  EXPECT_TRUE(summary.all_stale);
+  EXPECT_EQ(0u, summary.counts[Level_OK]);
+}
+
+TEST(StatusItem, updateVersion)
+{
+  boost::shared_ptr<StatusItem> item = makeItem("Motor", Level_OK, "Temperature", "20.0");
+  uint64_t version = item->getVersion();
+
+  // Sent again unchanged
+  diagnostic_msgs::DiagnosticStatus status = item->toRawStatusMsg();
+  EXPECT_TRUE(item->update(&status));
+  EXPECT_EQ(version, item->getVersion());
+
+  status.values[0].value = "21.0";
+  EXPECT_TRUE(item->update(&status));
+  EXPECT_NE(version, item->getVersion());
+  EXPECT_EQ("21.0", item->getValue("Temperature"));
+
+  // Not shared with other items
+  EXPECT_NE(item->getVersion(), makeItem("Motor", Level_OK, "Temperature", "21.0")->getVersion());
+}
+
+/*!
+ *\brief Status with a value per key, in this order
+ */
+static diagnostic_msgs::DiagnosticStatus keyedStatus(const char *keys[], unsigned int count)
+{
+  diagnostic_msgs::DiagnosticStatus status = makeStatus("Motor", Level_OK);
+  for (unsigned int i = 0; i < count; ++i)
+  {
+    diagnostic_msgs::KeyValue kv;
+    kv.key = keys[i];
+    kv.value = string("value of ") + keys[i];
+    status.values.push_back(kv);
+  }
+  return status;
+}
+
+// Items with many values are searched through an index, which must find the same keys
+TEST(StatusItem, findKeyIndexed)
+{
+  // 12 values, unsorted, "Voltage" twice
+  const char *keys[] = { "Voltage", "Current", "Temperature", "Mode", "Voltage", "Errors",
+                         "Aardvark", "Zulu", "Load", "Speed", "Position", "Torque" };
+  diagnostic_msgs::DiagnosticStatus status = keyedStatus(keys, 12);
+  StatusItem item(&status);
+
+  for (unsigned int i = 0; i < 12; ++i)
+  {
+    int expected = i == 4 ? 0 : i;
+    EXPECT_EQ(expected, item.findKey(keys[i])) << keys[i];
+    EXPECT_TRUE(item.hasKey(keys[i]));
+  }
+  EXPECT_EQ("value of Voltage", item.getValue("Voltage"));
+
+  // Before the first key, after the last, between two, and a prefix
+  EXPECT_EQ(-1, item.findKey("A"));
+  EXPECT_EQ(-1, item.findKey("Zz"));
+  EXPECT_EQ(-1, item.findKey("Mass"));
+  EXPECT_EQ(-1, item.findKey("Volt"));
+  EXPECT_FALSE(item.hasKey(""));
+  EXPECT_EQ("", item.getValue("Mass"));
+
+  // Reindexed when the values change, also below the threshold
+  const char *fewer[] = { "Zulu", "Mass", "Current" };
+  status = keyedStatus(fewer, 3);
+  item.update(&status);
+  EXPECT_EQ(1, item.findKey("Mass"));
+  EXPECT_EQ(-1, item.findKey("Voltage"));
+
+  const char *more[] = { "k9", "k8", "k7", "k6", "k5", "k4", "k3", "k2", "k1" };
+  status = keyedStatus(more, 9);
+  status.values[2].value = "7";
+  item.update(&status);
+  for (unsigned int i = 0; i < 9; ++i)
+    EXPECT_EQ(int(i), item.findKey(more[i])) << more[i];
+  EXPECT_EQ(-1, item.findKey("Mass"));
+
+  double number = 0;
+  EXPECT_TRUE(item.getNumericValue("k7", number));
+  EXPECT_DOUBLE_EQ(7, number);
+  EXPECT_FALSE(item.getNumericValue("k8", number));
+}
+
+// Updates item every interval seconds, count times
+static void updateEvery(StatusItem &item, double interval, unsigned int count)
+{
+  diagnostic_msgs::DiagnosticStatus status = item.toRawStatusMsg();
+  for (unsigned int i = 0; i < count; ++i)
+  {
+    ros::Time::setNow(ros::Time::now() + ros::Duration(interval));
+    item.update(&status);
+  }
+}
+
+TEST(StatusItem, updateIntervals)
+{
+  ros::Time::setNow(ros::Time(1000, 0));
+  boost::shared_ptr<StatusItem> item = makeItem("Motor", Level_OK, "Temperature", "20.0");
+  EXPECT_EQ(0, item->getUsualInterval());
+  EXPECT_FALSE(item->isRateDegraded(3, ros::Time(2000, 0)));
+
+  updateEvery(*item, 1.0, 1);
+  EXPECT_NEAR(1.0, item->getRecentInterval(), 1e-5);
+  EXPECT_NEAR(1.0, item->getUsualInterval(), 1e-5);
+
+  updateEvery(*item, 2.0, 1);
+  EXPECT_NEAR(1.25, item->getRecentInterval(), 1e-5);
+  EXPECT_NEAR(1.02, item->getUsualInterval(), 1e-5);
+}
+
+TEST(StatusItem, rateDegraded)
+{
+  ros::Time::setNow(ros::Time(1000, 0));
+  boost::shared_ptr<StatusItem> item = makeItem("Motor", Level_OK, "Temperature", "20.0");
+  updateEvery(*item, 1.0, 20);
+
+  ros::Time last_update = ros::Time::now();
+  EXPECT_FALSE(item->isRateDegraded(3, last_update + ros::Duration(2.9)));
+  EXPECT_TRUE(item->isRateDegraded(3, last_update + ros::Duration(3.1)));
+
+  // Recent updates slower than the threshold
+  updateEvery(*item, 8.0, 5);
+  EXPECT_GT(item->getRecentInterval(), 3 * item->getUsualInterval());
+  EXPECT_TRUE(item->isRateDegraded(3, ros::Time::now()));
+}
+
+TEST(StatusItem, watchRate)
+{
+  ros::Time::setNow(ros::Time(1000, 0));
+  boost::shared_ptr<StatusItem> watched = makeItem("Motor", Level_OK, "Temperature", "20.0");
+  boost::shared_ptr<StatusItem> unwatched = makeItem("Fan", Level_OK, "Temperature", "20.0");
+  watched->watchRate(5);
+  watched->watchRate(3);
+  watched->watchRate(0);
+
+  updateEvery(*watched, 1.0, 20);
+  ros::Time::setNow(ros::Time(1000, 0));
+  updateEvery(*unwatched, 1.0, 20);
+  EXPECT_NEAR(watched->getUsualInterval(), unwatched->getUsualInterval(), 1e-5);
+
+  // The slowdown is learned as the usual rate, unless it is degraded by the watched factor
+  ros::Time start = ros::Time::now();
+  updateEvery(*watched, 10.0, 20);
+  ros::Time::setNow(start);
+  updateEvery(*unwatched, 10.0, 20);
+  EXPECT_LT(watched->getUsualInterval(), 1.5);
+  EXPECT_GT(unwatched->getUsualInterval(), 3.5);
+  EXPECT_TRUE(watched->isRateDegraded(3, ros::Time::now()));
+  EXPECT_FALSE(unwatched->isRateDegraded(3, ros::Time::now()));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "status_item_test");
+
+  return RUN_ALL_TESTS();
+}
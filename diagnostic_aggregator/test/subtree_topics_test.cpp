@@ -0,0 +1,149 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <diagnostic_aggregator/aggregator.h>
+#include <ros/ros.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "test_helpers.h"
+
+using namespace std;
+using namespace diagnostic_aggregator;
+
+namespace diagnostic_aggregator {
+
+/*!
+ *\brief Publishes subtrees of chosen outputs, and reads back their publishers
+ */
+class AggregatorTest : public testing::Test
+{
+protected:
+  /*!
+   *\brief Publishes the subtrees of an output with a header status per subtree
+   */
+  void publish(const vector<string> &subtrees)
+  {
+    diagnostic_msgs::DiagnosticArray diag_array;
+    for (unsigned int i = 0; i < subtrees.size(); ++i)
+    {
+      diag_array.status.push_back(makeStatus("/Robot/" + subtrees[i], Level_OK));
+      diag_array.status.push_back(makeStatus("/Robot/" + subtrees[i] + "/item", Level_OK));
+    }
+    publish(diag_array);
+  }
+
+  void publish(const diagnostic_msgs::DiagnosticArray &diag_array)
+  {
+    aggregator_.publishSubtrees(diag_array);
+  }
+
+  /*!
+   *\brief Topic of each subtree publisher, by subtree
+   */
+  map<string, string> topics() const
+  {
+    map<string, string> topics;
+    map<string, ros::Publisher>::const_iterator it;
+    for (it = aggregator_.subtree_pubs_.begin(); it != aggregator_.subtree_pubs_.end(); ++it)
+      topics[it->first] = it->second.getTopic();
+    return topics;
+  }
+
+  Aggregator aggregator_;
+};
+
+}
+
+// Subtrees whose names are the same once replaced get numbered topics
+TEST_F(AggregatorTest, sameTopicNames)
+{
+  vector<string> subtrees;
+  subtrees.push_back("Power Systems");
+  subtrees.push_back("Power_Systems");
+  subtrees.push_back("Power-Systems");
+  subtrees.push_back("Motors");
+  publish(subtrees);
+
+  map<string, string> topics = this->topics();
+  ASSERT_EQ(4u, topics.size());
+  EXPECT_EQ("/diagnostics_agg/sub/Power_Systems", topics["Power Systems"]);
+  EXPECT_EQ("/diagnostics_agg/sub/Power_Systems_2", topics["Power_Systems"]);
+  EXPECT_EQ("/diagnostics_agg/sub/Power_Systems_3", topics["Power-Systems"]);
+  EXPECT_EQ("/diagnostics_agg/sub/Motors", topics["Motors"]);
+
+  // Publishing again keeps the topics
+  publish(subtrees);
+  EXPECT_EQ(topics, this->topics());
+}
+
+// Subtrees that are gone from the output stop being advertised, and free their topic
+TEST_F(AggregatorTest, goneSubtrees)
+{
+  vector<string> subtrees;
+  subtrees.push_back("Power Systems");
+  subtrees.push_back("Power_Systems");
+  subtrees.push_back("Motors");
+  publish(subtrees);
+  ASSERT_EQ(3u, topics().size());
+
+  vector<string> remaining(1, "Power_Systems");
+  publish(remaining);
+  map<string, string> topics = this->topics();
+  ASSERT_EQ(1u, topics.size());
+  EXPECT_EQ("/diagnostics_agg/sub/Power_Systems_2", topics["Power_Systems"]);
+
+  // Back again, gets the topic that was freed
+  publish(subtrees);
+  topics = this->topics();
+  ASSERT_EQ(3u, topics.size());
+  EXPECT_EQ("/diagnostics_agg/sub/Power_Systems", topics["Power Systems"]);
+  EXPECT_EQ("/diagnostics_agg/sub/Power_Systems_2", topics["Power_Systems"]);
+  EXPECT_EQ("/diagnostics_agg/sub/Motors", topics["Motors"]);
+
+  // Statuses outside of the base path aren't subtrees
+  diagnostic_msgs::DiagnosticArray other;
+  other.status.push_back(makeStatus("/Other/Motors", Level_OK));
+  publish(other);
+  EXPECT_TRUE(this->topics().empty());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "subtree_topics_test");
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,130 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef DIAGNOSTIC_AGGREGATOR_TEST_HELPERS_H
+#define DIAGNOSTIC_AGGREGATOR_TEST_HELPERS_H
+
+#include <diagnostic_aggregator/status_item.h>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+// Helpers shared by the unit tests
+
+typedef std::vector<boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> > Report;
+
+/*!
+ *\brief Status with up to two values, a value is left out if its key is empty
+ */
+inline diagnostic_msgs::DiagnosticStatus makeStatus(const std::string &name, int8_t level,
+                                                    const std::string &key = "", const std::string &value = "",
+                                                    const std::string &key2 = "", const std::string &value2 = "")
+{
+  diagnostic_msgs::DiagnosticStatus status;
+  status.name = name;
+  status.level = level;
+  status.message = diagnostic_aggregator::valToMsg(level);
+
+  diagnostic_msgs::KeyValue kv;
+  if (!key.empty())
+  {
+    kv.key = key;
+    kv.value = value;
+    status.values.push_back(kv);
+  }
+  if (!key2.empty())
+  {
+    kv.key = key2;
+    kv.value = value2;
+    status.values.push_back(kv);
+  }
+
+  return status;
+}
+
+/*!
+ *\brief Item of makeStatus(), updated at ros::Time::now()
+ */
+inline boost::shared_ptr<diagnostic_aggregator::StatusItem> makeItem(const std::string &name, int8_t level,
+                                                                     const std::string &key = "", const std::string &value = "",
+                                                                     const std::string &key2 = "", const std::string &value2 = "")
+{
+  diagnostic_msgs::DiagnosticStatus status = makeStatus(name, level, key, value, key2, value2);
+  return boost::shared_ptr<diagnostic_aggregator::StatusItem>(new diagnostic_aggregator::StatusItem(&status));
+}
+
+/*!
+ *\brief Status of report with that name, NULL if there is none
+ */
+inline boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> findStatus(const Report &report, const std::string &name)
+{
+  for (unsigned int i = 0; i < report.size(); ++i)
+  {
+    if (report[i]->name == name)
+      return report[i];
+  }
+
+  return boost::shared_ptr<diagnostic_msgs::DiagnosticStatus>();
+}
+
+/*!
+ *\brief Level of the status of report with that name, a test failure if there is none
+ */
+inline int8_t reportedLevel(const Report &report, const std::string &name)
+{
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> status = findStatus(report, name);
+  if (!status)
+  {
+    ADD_FAILURE() << "Status " << name << " not reported";
+    return -1;
+  }
+
+  return status->level;
+}
+
+/*!
+ *\brief Value of key in status, empty if there is none
+ */
+inline std::string findValue(const diagnostic_msgs::DiagnosticStatus &status, const std::string &key)
+{
+  for (unsigned int i = 0; i < status.values.size(); ++i)
+  {
+    if (status.values[i].key == key)
+      return status.values[i].value;
+  }
+
+  return "";
+}
+
+#endif // DIAGNOSTIC_AGGREGATOR_TEST_HELPERS_H
@@ -0,0 +1,130 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <diagnostic_aggregator/threshold_analyzer.h>
+#include <ros/ros.h>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "test_helpers.h"
+
+using namespace std;
+using namespace diagnostic_aggregator;
+
+TEST(ThresholdAnalyzer, thresholds)
+{
+  ThresholdAnalyzer analyzer;
+  ASSERT_TRUE(analyzer.init("/Robot", ros::NodeHandle("~motors")));
+
+  analyzer.analyze(makeItem("Motor Cool", Level_OK, "Temperature", "20.0"));
+  analyzer.analyze(makeItem("Motor Warm", Level_OK, "Temperature", "75.5"));
+  analyzer.analyze(makeItem("Motor Hot", Level_OK, "Temperature", "85 C"));
+  analyzer.analyze(makeItem("Motor Low", Level_OK, "Voltage", "10.5"));
+  analyzer.analyze(makeItem("Motor Charged", Level_OK, "Voltage", "12.1"));
+  analyzer.analyze(makeItem("Motor Unknown", Level_OK, "Temperature", "hot"));
+  analyzer.analyze(makeItem("Motor Infinite", Level_OK, "Temperature", "inf"));
+  analyzer.analyze(makeItem("Motor Other", Level_OK, "Current", "100"));
+
+  Report report = analyzer.report();
+  EXPECT_EQ(Level_OK, reportedLevel(report, "/Robot/Motors/Motor Cool"));
+  EXPECT_EQ(Level_Warn, reportedLevel(report, "/Robot/Motors/Motor Warm"));
+  EXPECT_EQ(Level_Error, reportedLevel(report, "/Robot/Motors/Motor Hot"));
+  EXPECT_EQ(Level_Error, reportedLevel(report, "/Robot/Motors/Motor Low"));
+  EXPECT_EQ(Level_OK, reportedLevel(report, "/Robot/Motors/Motor Charged"));
+  EXPECT_EQ(Level_OK, reportedLevel(report, "/Robot/Motors/Motor Unknown"));
+  EXPECT_EQ(Level_OK, reportedLevel(report, "/Robot/Motors/Motor Infinite"));
+  EXPECT_EQ(Level_OK, reportedLevel(report, "/Robot/Motors/Motor Other"));
+  EXPECT_EQ(Level_Error, reportedLevel(report, "/Robot/Motors"));
+}
+
+// The item keeps its own level if it's higher than the thresholds
+TEST(ThresholdAnalyzer, higherLevelKept)
+{
+  ThresholdAnalyzer analyzer;
+  ASSERT_TRUE(analyzer.init("/Robot", ros::NodeHandle("~motors")));
+
+  boost::shared_ptr<StatusItem> item = makeItem("Motor Broken", Level_OK, "Temperature", "75.5");
+  diagnostic_msgs::DiagnosticStatus status = item->toRawStatusMsg();
+  status.level = diagnostic_msgs::DiagnosticStatus::ERROR;
+  status.message = "Encoder fault";
+  item->update(&status);
+  analyzer.analyze(item);
+
+  Report report = analyzer.report();
+  EXPECT_EQ(Level_Error, reportedLevel(report, "/Robot/Motors/Motor Broken"));
+  EXPECT_EQ(Level_Error, item->getLevel());
+}
+
+// The item is reported with the raised level, but is kept as it is
+TEST(ThresholdAnalyzer, itemKept)
+{
+  ThresholdAnalyzer analyzer;
+  ASSERT_TRUE(analyzer.init("/Robot", ros::NodeHandle("~motors")));
+
+  boost::shared_ptr<StatusItem> item = makeItem("Motor Hot", Level_OK, "Temperature", "85");
+  analyzer.analyze(item);
+
+  Report report = analyzer.report();
+  boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> status = findStatus(report, "/Robot/Motors/Motor Hot");
+  ASSERT_TRUE(status);
+  EXPECT_EQ(Level_Error, status->level);
+  EXPECT_EQ("Temperature 85 above 80", status->message);
+  EXPECT_EQ("Temperature 85 above 80", findValue(*findStatus(report, "/Robot/Motors"), "Motor Hot"));
+  EXPECT_EQ(Level_OK, item->getLevel());
+  EXPECT_EQ("OK", item->getMessage());
+
+  // Made from the item, and told apart from its own level
+  const StatusMsgSource *source = boost::get_deleter<StatusMsgSource>(status);
+  ASSERT_TRUE(source);
+  EXPECT_EQ(item->getVersion(), source->version);
+  EXPECT_NE(0u, source->override_hash);
+
+  // Back under the thresholds
+  diagnostic_msgs::DiagnosticStatus cool = item->toRawStatusMsg();
+  cool.values[0].value = "20";
+  item->update(&cool);
+  analyzer.analyze(item);
+
+  report = analyzer.report();
+  EXPECT_EQ(Level_OK, reportedLevel(report, "/Robot/Motors/Motor Hot"));
+  EXPECT_EQ("OK", findValue(*findStatus(report, "/Robot/Motors"), "Motor Hot"));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "threshold_analyzer_test");
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,97 @@
+#!/usr/bin/env python
+# Software License Agreement (BSD License)
+#
+# Copyright (c) 2009, Willow Garage, Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above
+#    copyright notice, this list of conditions and the following
+#    disclaimer in the documentation and/or other materials provided
+#    with the distribution.
+#  * Neither the name of the Willow Garage nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+# FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+# COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+# INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+# ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+
+##\brief Tests that an UpstreamAnalyzer reports another aggregator's output under its path
+
+from __future__ import with_statement
+DURATION = 10
+PKG = 'diagnostic_aggregator'
+import roslib; roslib.load_manifest(PKG)
+import rospy, rostest, unittest
+from diagnostic_msgs.msg import DiagnosticArray, DiagnosticStatus, KeyValue
+from time import sleep
+import sys
+import threading
+
+FLEET_PATH = '/Fleet/Robot 1'
+
+class TestUpstream(unittest.TestCase):
+    def __init__(self, *args):
+        super(TestUpstream, self).__init__(*args)
+
+        self._mutex = threading.Lock()
+
+        self._robot = {}
+        self._fleet = {}
+
+        rospy.init_node('test_upstream')
+        self._starttime = rospy.get_time()
+
+        sub_robot = rospy.Subscriber("/robot1/diagnostics_agg", DiagnosticArray, self.robot_cb)
+        sub_fleet = rospy.Subscriber("/diagnostics_agg", DiagnosticArray, self.fleet_cb)
+
+    def robot_cb(self, msg):
+        with self._mutex:
+            for stat in msg.status:
+                self._robot[stat.name] = stat
+
+    def fleet_cb(self, msg):
+        with self._mutex:
+            for stat in msg.status:
+                self._fleet[stat.name] = stat
+
+    def test_upstream(self):
+        while not rospy.is_shutdown():
+            sleep(1.0)
+            if rospy.get_time() - self._starttime > DURATION:
+                break
+
+        self.assert_(not rospy.is_shutdown(), "Rospy shutdown!")
+
+        with self._mutex:
+            self.assert_(len(self._robot) > 0, "No output from robot aggregator")
+            self.assert_(self._fleet.has_key(FLEET_PATH), "No header for upstream subtree. Items: %s" % self._fleet.keys())
+
+            top_level = 0
+            for name, stat in self._robot.iteritems():
+                self.assert_(self._fleet.has_key(FLEET_PATH + name), "Robot item %s not in fleet output" % name)
+                if name.find('/', 1) < 0:
+                    top_level = max(top_level, stat.level)
+
+            # Stale is an error unless all are stale, robot has fresh items
+            self.assert_(self._fleet[FLEET_PATH].level == min(top_level, 2),
+                         "Subtree header level %d doesn't match robot top level %d" % (self._fleet[FLEET_PATH].level, top_level))
+
+if __name__ == '__main__':
+    rostest.run(PKG, sys.argv[0], TestUpstream, sys.argv)